@@ -3,21 +3,48 @@
 #include "synthesizer.h"
 #include "third_party/portaudio.h"
 #include <atomic>
+#include <condition_variable>
 
 namespace primesynth {
 class AudioOutput {
 public:
+    enum class RenderMode {
+        // rendering thread keeps ring buffer filled
+        Thread,
+        // stream callback renders requested frames directly into device buffer
+        Callback,
+        // rendering thread woken by stream callback renders one period ahead
+        Ahead
+    };
+
     AudioOutput(Synthesizer& synth, std::size_t bufferSize, int deviceID = getDefaultDeviceID(),
-                double sampleRate = getDefaultSampleRate());
+                double sampleRate = getDefaultSampleRate(), RenderMode renderMode = RenderMode::Thread);
     ~AudioOutput();
 
     static int getDefaultDeviceID();
     static double getDefaultSampleRate();
 
+    // frames between rendering of a frame and its playback
+    std::size_t getLatency() const;
+
 private:
+    Synthesizer& synth_;
+    const RenderMode renderMode_;
+    const double sampleRate_;
+    const std::size_t bufferSize_;
     RingBuffer buffer_;
     PaStream* stream_;
     std::thread renderingThread;
     std::atomic_bool running_;
+
+    // for RenderMode::Ahead
+    std::atomic_size_t period_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    static int streamCallback(const void*, void* output, unsigned long frameCount, const PaStreamCallbackTimeInfo*,
+                              PaStreamCallbackFlags, void* userData);
+    void doRenderingLoop();
+    void doRenderingAheadLoop();
 };
 }
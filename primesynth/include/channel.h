@@ -1,7 +1,6 @@
 #pragma once
 #include "midi.h"
-#include "voice.h"
-#include <mutex>
+#include "voice_pool.h"
 
 namespace primesynth {
 class Channel {
@@ -10,15 +9,25 @@ public:
 
     midi::Bank getBank() const;
     bool hasPreset() const;
+    const VoicePool& getVoices() const;
+    // number of voices which are neither killed nor finished
+    std::size_t getNumVoices() const;
 
     void noteOff(std::uint8_t key);
-    void noteOn(std::uint8_t key, std::uint8_t velocity);
+    // noteID identifies the note among all channels and increases with each note-on
+    void noteOn(std::uint8_t key, std::uint8_t velocity, std::size_t noteID);
     void keyPressure(std::uint8_t key, std::uint8_t value);
     void controlChange(std::uint8_t controller, std::uint8_t value);
     void channelPressure(std::uint8_t value);
     void pitchBend(std::uint16_t value);
+    // preallocates memory for capacity voices, so that note-on does not allocate
+    void reserveVoices(std::size_t capacity);
     void setPreset(const std::shared_ptr<const Preset>& preset);
-    StereoValue render();
+    void setInterpolation(kernel::Interpolation interpolation);
+    // collects voices to be rendered in next block and returns number of them
+    std::size_t collectActiveVoices();
+    void render(std::size_t beginVoice, std::size_t endVoice, const Buses& buses, std::size_t frames,
+                const RenderContext& context);
 
 private:
     enum class DataEntryMode { RPN, NRPN };
@@ -33,13 +42,20 @@ private:
     DataEntryMode dataEntryMode_;
     double pitchBendSensitivity_;
     double fineTuning_, coarseTuning_;
-    std::vector<std::unique_ptr<Voice>> voices_;
-    std::size_t currentNoteID_;
-    std::mutex mutex_;
+    VoicePool voices_;
+    // MIDI controllers which modulators of voices depend on
+    // bits of finished voices are cleared when voices are collected for next block
+    std::bitset<midi::NUM_CONTROLLERS> voiceControllers_;
+    // note IDs sounding on a key, reused by limitNotesPerKey
+    std::vector<std::size_t> noteIDs_;
 
     std::uint16_t getSelectedRPN() const;
 
-    void addVoice(std::unique_ptr<Voice> voice);
+    void limitNotesPerKey(std::uint8_t key);
+    // applies state of channel to voice just added
+    void startVoice(Voice& voice);
+    // passes controller to voices which depend on it
+    void updateMIDIController(std::uint8_t controller, std::uint8_t value);
     void updateRPN();
 };
 }
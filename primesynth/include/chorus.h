@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+
+namespace primesynth {
+// modulated delay chorus shared by all voices
+// left and right taps are swept by a triangle LFO in quadrature
+class Chorus {
+public:
+    explicit Chorus(double outputRate);
+
+    // adds chorused mono input to left and right
+    // does nothing while input is silent and the delay line has been drained
+    void process(const float* input, float* left, float* right, std::size_t frames);
+
+private:
+    std::vector<float> line_;
+    std::size_t mask_, position_;
+    // in frames
+    float delay_, depth_;
+    // LFO phase in [0, 1) and its increment per frame
+    float phase_, deltaPhase_;
+    std::size_t silentFrames_;
+
+    void processFrames(const float* input, float* left, float* right, std::size_t frames);
+};
+}
@@ -3,8 +3,6 @@
 
 namespace primesynth {
 namespace conv {
-void initialize();
-
 // attenuation: centibel
 // amplitude:   normalized linear value in [0, 1]
 double attenuationToAmplitude(double atten);
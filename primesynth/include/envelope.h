@@ -2,26 +2,35 @@
 #include <array>
 
 namespace primesynth {
+// envelope advanced by arbitrary numbers of frames in closed form
+// values are linear within each phase, so callers can ramp linearly between phase changes
 class Envelope {
 public:
     enum class Phase { Delay, Attack, Hold, Decay, Sustain, Release, Finished };
 
-    Envelope(double outputRate, unsigned int interval);
+    explicit Envelope(double outputRate);
 
     Phase getPhase() const;
     double getValue() const;
+    // frames until current phase ends, or UINT_MAX if it lasts until release
+    unsigned int getFramesUntilPhaseChange() const;
 
     void setParameter(Phase phase, double param);
     void release();
-    void update();
+    void update(unsigned int frames);
 
 private:
-    const double effectiveOutputRate_;
+    const double outputRate_;
+    // lengths of Delay, Attack, Hold, Decay and Release phases in frames, and sustain level
+    // length of Decay is time to fall from 1 to 0, and that of Release is time to fall from 1
     std::array<double, static_cast<std::size_t>(Phase::Finished)> params_;
     Phase phase_;
-    unsigned int phaseSteps_;
-    double value_;
+    // frames elapsed in current phase
+    double phaseFrames_;
+    double value_, releaseValue_;
 
+    // frames from start of current phase to its end
+    double getPhaseLength() const;
     void changePhase(Phase phase);
 };
 }
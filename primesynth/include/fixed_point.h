@@ -21,6 +21,14 @@ public:
         return (raw_ & UINT32_MAX) / (UINT32_MAX + 1.0);
     }
 
+    std::uint64_t getRaw() const {
+        return raw_;
+    }
+
+    void setRaw(std::uint64_t raw) {
+        raw_ = raw;
+    }
+
     double getReal() const {
         return getIntegerPart() + getFractionalPart();
     }
@@ -0,0 +1,31 @@
+#pragma once
+#include "voice_pool.h"
+
+namespace primesynth {
+// adapts rendering quality to CPU load
+// load is the ratio of rendering time to real time of rendered frames
+// quality is lowered one level at a time while load is high, and raised again after load stays low for a while
+class Governor {
+public:
+    struct Level {
+        QualityLimits qualityLimits;
+        // fraction of polyphony limit
+        double polyphonyScale;
+    };
+
+    Governor();
+
+    void setEnabled(bool enabled);
+    const Level& getLevel() const;
+
+    // returns true if level has changed
+    bool update(double renderTime, double realTime);
+
+private:
+    bool enabled_;
+    std::size_t level_;
+    double load_;
+    // seconds of rendered audio
+    double holdTime_, lowLoadTime_;
+};
+}
@@ -4,8 +4,7 @@
 namespace primesynth {
 class LFO {
 public:
-    LFO(double outputRate, unsigned int interval)
-        : outputRate_(outputRate), interval_(interval), steps_(0), delay_(0), delta_(0.0), value_(0.0), up_(true) {}
+    explicit LFO(double outputRate) : outputRate_(outputRate), delay_(0), delta_(0.0), value_(0.0), up_(true) {}
 
     double getValue() const {
         return value_;
@@ -16,23 +15,22 @@ public:
     }
 
     void setFrequency(double freq) {
-        delta_ = 4.0 * interval_ * conv::absoluteCentToHertz(freq) / outputRate_;
+        delta_ = 4.0 * conv::absoluteCentToHertz(freq) / outputRate_;
     }
 
-    void update() {
-        if (steps_ <= delay_) {
-            ++steps_;
-            return;
+    // advances by frames, reflecting triangle wave at its peaks
+    void update(unsigned int frames) {
+        if (delay_ > 0) {
+            const unsigned int elapsed = std::min(delay_, frames);
+            delay_ -= elapsed;
+            frames -= elapsed;
         }
-        if (up_) {
-            value_ += delta_;
+        value_ += (up_ ? delta_ : -delta_) * frames;
+        while (value_ > 1.0 || value_ < -1.0) {
             if (value_ > 1.0) {
                 value_ = 2.0 - value_;
                 up_ = false;
-            }
-        } else {
-            value_ -= delta_;
-            if (value_ < -1.0) {
+            } else {
                 value_ = -2.0 - value_;
                 up_ = true;
             }
@@ -41,8 +39,8 @@ public:
 
 private:
     const double outputRate_;
-    const unsigned int interval_;
-    unsigned int steps_, delay_;
+    // frames left before oscillation starts
+    unsigned int delay_;
     double delta_, value_;
     bool up_;
 };
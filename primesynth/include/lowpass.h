@@ -0,0 +1,8 @@
+#pragma once
+#include "voice_kernel.h"
+
+namespace primesynth {
+// cutoff is frequency relative to output rate
+// resonance is height of resonant peak above DC gain in centibel
+kernel::LowpassCoefficients calculateLowpass(double cutoff, double resonance);
+}
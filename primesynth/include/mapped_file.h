@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+
+namespace primesynth {
+// read-only memory mapping of a whole file
+// pages are shared with page cache and other processes mapping the same file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* getData() const;
+    std::size_t getSize() const;
+
+    // hints that bytes in range will be read, so that they are paged in ahead in background
+    void prefetch(std::size_t offset, std::size_t size) const;
+    // reads pages in range in and keeps them in memory until unlocked
+    // offset must be a multiple of page size, and this fails beyond the limit of locked memory of the process
+    bool lock(std::size_t offset, std::size_t size) const;
+    void unlock(std::size_t offset, std::size_t size) const;
+
+private:
+    const char* data_;
+    std::size_t size_;
+};
+}
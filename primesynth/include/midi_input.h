@@ -13,9 +13,15 @@ public:
         bool addingBufferRequested;
         std::mutex mutex;
         std::condition_variable cv;
+
+        // maps driver timestamps to synthesizer clock
+        std::uint64_t latency;
+        bool anchored;
+        std::int64_t timeOffset;
     };
 
-    MIDIInput(Synthesizer& synth, UINT deviceID, bool verbose = false);
+    // latency is in frames, and should cover audio output buffer so that events are scheduled ahead of rendering
+    MIDIInput(Synthesizer& synth, UINT deviceID, std::size_t latency = 0, bool verbose = false);
     ~MIDIInput();
 
 private:
@@ -7,6 +7,9 @@ public:
     explicit Modulator(const sf::ModList& param);
 
     sf::Generator getDestination() const;
+    // controllers which value depends on
+    const sf::Modulator& getSource() const;
+    const sf::Modulator& getAmountSource() const;
     std::int16_t getAmount() const;
     bool canBeNegative() const;
     double getValue() const;
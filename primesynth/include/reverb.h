@@ -0,0 +1,30 @@
+#pragma once
+#include <array>
+#include <vector>
+
+namespace primesynth {
+// feedback delay network reverb shared by all voices
+// eight delay lines are fed back through a Hadamard matrix, with a damping low-pass on each line
+class Reverb {
+public:
+    explicit Reverb(double outputRate);
+
+    // adds reverberation of mono input to left and right
+    // does nothing while input is silent and the tail has died away
+    void process(const float* input, float* left, float* right, std::size_t frames);
+
+private:
+    static constexpr std::size_t NUM_LINES = 8;
+
+    // frame-major, so that all lines are written by a single store per frame
+    std::vector<float> lines_;
+    std::size_t mask_, position_;
+    std::array<std::size_t, NUM_LINES> delays_;
+    alignas(16) std::array<float, NUM_LINES> gains_, damped_;
+    bool idle_;
+    // every point of the lines is read within a window as long as the longest delay,
+    // so peak of outputs over a window with silent input tells whether the tail has died away
+    std::size_t windowFrames_, silentFrames_;
+    float windowPeak_;
+};
+}
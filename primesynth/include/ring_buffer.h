@@ -1,43 +1,59 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <vector>
 
 namespace primesynth {
+// lock-free ring buffer for single producer and single consumer
+// size must be a power of two
 class RingBuffer {
 public:
-    explicit RingBuffer(std::size_t size) : size_(size), data_(size) {}
+    explicit RingBuffer(std::size_t size) : size_(size), data_(size), start_(0), end_(0) {}
 
     bool empty() const {
-        return start_ >= end_;
-    }
-
-    bool full() const {
-        return end_ - start_ >= size_;
+        return size() == 0;
     }
 
+    // number of elements which can be read
     std::size_t size() const {
-        return end_ - start_;
+        return end_.load(std::memory_order_acquire) - start_.load(std::memory_order_acquire);
     }
 
+    // number of elements which can be written
     std::size_t capacity() const {
         return size_ - size();
     }
 
-    void push(float t) {
-        data_.at(mask(end_++)) = t;
-    }
-
-    float shift() {
-        return data_.at(mask(start_++));
+    // called only by producer
+    // returns number of elements actually written
+    std::size_t write(const float* data, std::size_t count) {
+        const std::size_t end = end_.load(std::memory_order_relaxed);
+        count = std::min(count, size_ - (end - start_.load(std::memory_order_acquire)));
+        const std::size_t first = std::min(count, size_ - mask(end));
+        std::memcpy(data_.data() + mask(end), data, first * sizeof(float));
+        std::memcpy(data_.data(), data + first, (count - first) * sizeof(float));
+        end_.store(end + count, std::memory_order_release);
+        return count;
     }
 
-    void clear() {
-        start_ = end_;
+    // called only by consumer
+    // returns number of elements actually read
+    std::size_t read(float* data, std::size_t count) {
+        const std::size_t start = start_.load(std::memory_order_relaxed);
+        count = std::min(count, end_.load(std::memory_order_acquire) - start);
+        const std::size_t first = std::min(count, size_ - mask(start));
+        std::memcpy(data, data_.data() + mask(start), first * sizeof(float));
+        std::memcpy(data + first, data_.data(), (count - first) * sizeof(float));
+        start_.store(start + count, std::memory_order_release);
+        return count;
     }
 
 private:
-    std::size_t size_;
+    const std::size_t size_;
     std::vector<float> data_;
-    std::size_t start_ = 0, end_ = 0;
+    alignas(64) std::atomic_size_t start_;
+    alignas(64) std::atomic_size_t end_;
 
     std::size_t mask(std::size_t i) const {
         return i & (size_ - 1);
@@ -0,0 +1,57 @@
+#pragma once
+#include "mapped_file.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace primesynth {
+// pages in mapped sample points ahead of voices on a background thread, so that rendering does not wait for disk
+// points are divided into blocks of whole pages, which are locked in memory once they have been read
+// voices request blocks they are about to read, and are silenced rather than reading blocks which are not ready
+// blocks which no voice has requested for a while are unlocked again, so that locked memory follows what is playing
+class SampleStreamer {
+public:
+    // number of bytes in a block, a multiple of page size
+    static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+
+    // streams size points at offset bytes in file
+    SampleStreamer(const MappedFile& file, std::size_t offset, std::size_t size);
+    ~SampleStreamer();
+    SampleStreamer(const SampleStreamer&) = delete;
+    SampleStreamer& operator=(const SampleStreamer&) = delete;
+
+    // reads points from begin to (end - 1) on calling thread, and keeps them in memory for lifetime of streamer
+    void preload(std::size_t begin, std::size_t end);
+    // returns whether points from begin to (end - 1) are ready, and requests those which are not
+    // a few blocks following the range are requested as well, so that they are ready before voices reach them
+    // can be called concurrently
+    bool request(std::size_t begin, std::size_t end);
+
+private:
+    enum BlockState : std::uint8_t { Idle, Requested, Ready, Preloaded };
+
+    const MappedFile& file_;
+    std::size_t offset_, size_;
+    // index of first block counted from beginning of file
+    std::size_t firstBlock_;
+    std::vector<std::atomic<std::uint8_t>> states_;
+    // value of epoch_ when each block was last requested
+    std::vector<std::atomic<std::uint32_t>> lastRequests_;
+    std::atomic<std::uint32_t> epoch_;
+
+    std::mutex mutex_;
+    std::condition_variable requested_;
+    // blocks which have turned Requested since streamer thread last woke up
+    // each block is queued at most once, so that capacity reserved for all blocks is never exceeded
+    std::vector<std::size_t> requests_;
+    bool running_;
+    std::thread thread_;
+
+    std::size_t getBlock(std::size_t point) const;
+    void read(std::size_t block) const;
+    void evict();
+    void streamerLoop();
+};
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include "mapped_file.h"
+#include "sample_streamer.h"
 #include "soundfont_spec.h"
 #include <array>
 #include <vector>
@@ -6,15 +8,62 @@
 namespace primesynth {
 static constexpr std::size_t NUM_GENERATORS = static_cast<std::size_t>(sf::Generator::Last);
 static constexpr std::uint16_t PERCUSSION_BANK = 128;
+static constexpr std::size_t NUM_KEYS = 128;
+
+// how sample points of a SoundFont are loaded
+enum class SampleLoading {
+    // read into memory
+    Read,
+    // mapped from file, with heads of samples paged in ahead at load and the rest paged in where first read
+    Map,
+    // mapped from file, with heads of samples and short loops paged in at load,
+    // and the rest paged in ahead of voices on a background thread
+    Stream
+};
+
+// sample points of a SoundFont, which are either read into memory or mapped from file
+class SampleBuffer {
+public:
+    SampleBuffer() : data_(nullptr), size_(0), streamer_(nullptr) {}
+    SampleBuffer(const std::int16_t* data, std::size_t size, SampleStreamer* streamer = nullptr)
+        : data_(data), size_(size), streamer_(streamer) {}
+
+    const std::int16_t* data() const {
+        return data_;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    const std::int16_t& at(std::size_t i) const {
+        if (i >= size_) {
+            throw std::out_of_range("sample point out of range");
+        }
+        return data_[i];
+    }
+
+    // null unless points are streamed
+    SampleStreamer* streamer() const {
+        return streamer_;
+    }
+
+private:
+    const std::int16_t* data_;
+    std::size_t size_;
+    SampleStreamer* streamer_;
+};
 
 struct Sample {
     std::string name;
     std::uint32_t start, end, startLoop, endLoop, sampleRate;
     std::int8_t key, correction;
+    // attenuation of peak, which is 0 if peak is not scanned
     double minAtten;
-    const std::vector<std::int16_t>& buffer;
+    const SampleBuffer& buffer;
 
-    Sample(const sf::Sample& sample, const std::vector<std::int16_t>& sampleBuffer);
+    // scanning peak touches all points, so it is skipped for mapped buffers to keep them paged out until played
+    Sample(const sf::Sample& sample, const SampleBuffer& sampleBuffer, bool scanPeak);
 };
 
 class GeneratorSet {
@@ -74,19 +123,40 @@ struct Instrument {
 
 class SoundFont;
 
+// generators and modulators of a preset zone merged with those of an instrument zone
+// voices are instantiated from these at note-on
+struct VoiceTemplate {
+    Zone::Range keyRange, velocityRange;
+    std::int16_t sampleID;
+    GeneratorSet generators;
+    ModulatorParameterSet modulatorParameters;
+};
+
 struct Preset {
+    using TemplateIterator = std::vector<const VoiceTemplate*>::const_iterator;
+
     std::string name;
     std::uint16_t bank, presetID;
     std::vector<Zone> zones;
     const SoundFont& soundFont;
+    // one for each pair of zones whose ranges overlap, in order of preset zones and then instrument zones
+    std::vector<VoiceTemplate> voiceTemplates;
+    // voice templates grouped by key, whose k-th group begins at keyOffsets[k]
+    std::vector<const VoiceTemplate*> keyTemplates;
+    std::array<std::size_t, NUM_KEYS + 1> keyOffsets;
 
+    // instruments of sfont must have been read
     Preset(std::vector<sf::PresetHeader>::const_iterator phdrIter, const std::vector<sf::Bag>& pbag,
            const std::vector<sf::ModList>& pmod, const std::vector<sf::GenList>& pgen, const SoundFont& sfont);
+
+    // returns range of voice templates whose key ranges contain key
+    std::pair<TemplateIterator, TemplateIterator> getVoiceTemplates(std::uint8_t key) const;
 };
 
 class SoundFont {
 public:
-    explicit SoundFont(const std::string& filename);
+    // sample points are read into memory if mapping fails
+    explicit SoundFont(const std::string& filename, SampleLoading sampleLoading = SampleLoading::Read);
 
     const std::string& getName() const;
     const std::vector<Sample>& getSamples() const;
@@ -95,7 +165,12 @@ public:
 
 private:
     std::string name_;
-    std::vector<std::int16_t> sampleBuffer_;
+    SampleLoading sampleLoading_;
+    std::unique_ptr<MappedFile> sampleFile_;
+    // destroyed before file is unmapped
+    std::unique_ptr<SampleStreamer> sampleStreamer_;
+    std::vector<std::int16_t> sampleMemory_;
+    SampleBuffer sampleBuffer_;
     std::vector<Sample> samples_;
     std::vector<Instrument> instruments_;
     std::vector<std::shared_ptr<const Preset>> presets_;
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+namespace primesynth {
+// wait-free bounded queue for single producer and single consumer
+template <typename T>
+class SPSCQueue {
+public:
+    // capacity must be a power of two
+    explicit SPSCQueue(std::size_t capacity) : data_(capacity), mask_(capacity - 1), head_(0), tail_(0) {}
+
+    // called only by producer
+    // returns false if queue is full
+    bool push(const T& value) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        data_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // called only by consumer
+    // returns nullptr if queue is empty
+    const T* front() const {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &data_[head & mask_];
+    }
+
+    // called only by consumer after front() returned an element
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> data_;
+    const std::size_t mask_;
+    alignas(64) std::atomic_size_t head_;
+    alignas(64) std::atomic_size_t tail_;
+};
+}
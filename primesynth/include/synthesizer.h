@@ -1,26 +1,103 @@
 #pragma once
 #include "channel.h"
+#include "chorus.h"
+#include "governor.h"
+#include "reverb.h"
+#include "spsc_queue.h"
+#include "worker_pool.h"
+#include <unordered_map>
 
 namespace primesynth {
 class Synthesizer {
 public:
     Synthesizer(double outputRate = 44100, std::size_t numChannels = 16);
 
-    StereoValue render() const;
+    void renderBlock(float* left, float* right, std::size_t frames);
+    void renderBlockInterleaved(float* buffer, std::size_t frames);
 
-    void loadSoundFont(const std::string& filename);
+    // number of frames rendered so far, which serves as clock for event timestamps
+    std::uint64_t getCurrentFrame() const;
+    double getOutputRate() const;
+
+    void loadSoundFont(const std::string& filename, SampleLoading sampleLoading = SampleLoading::Read);
     void setVolume(double volume);
+    // must not be called while rendering
+    void setNumThreads(std::size_t numThreads);
+    // maximum number of voices among all channels, 0 means unlimited
+    // voices of each channel are preallocated accordingly, so this must be called before rendering starts
+    void setPolyphony(std::size_t polyphony);
+    // voices are culled when their estimated output falls below absolute threshold,
+    // or below relative threshold from peak of the previous block
+    // thresholds are in dB, and 0 disables each
+    void setCullingThresholds(double absoluteThreshold, double relativeThreshold);
+    // must not be called while rendering
+    void setInterpolation(kernel::Interpolation interpolation);
+    void setInterpolation(std::size_t channelID, kernel::Interpolation interpolation);
+    // lowers interpolation, control rate and polyphony when rendering cannot keep up with real time
+    void setGovernorEnabled(bool enabled);
     void setMIDIStandard(midi::Standard midiStandard, bool fixed = false);
-    void processShortMessage(std::uint32_t param);
-    void processSysEx(const char* data, std::size_t length);
+
+    // MIDI messages can be sent from another thread than rendering one
+    // they are queued and take effect on frame `time` of synthesizer clock
+    // messages with past timestamps take effect at the beginning of next block
+    // timestamps must not decrease
+    // when the queue is full, callers wait until rendering consumes events, so they must not be on the rendering thread
+    void processShortMessage(std::uint32_t param, std::uint64_t time = 0);
+    void processSysEx(const char* data, std::size_t length, std::uint64_t time = 0);
 
 private:
+    struct Event {
+        enum class Type { ShortMessage, MIDIStandard };
+
+        Type type;
+        std::uint32_t param;
+        std::uint64_t time;
+    };
+
     midi::Standard midiStd_, defaultMIDIStd_;
     bool stdFixed_;
     std::vector<std::unique_ptr<Channel>> channels_;
     std::vector<std::unique_ptr<SoundFont>> soundFonts_;
+    // presets keyed by bank and preset number, from SoundFont loaded first among those defining each
+    std::unordered_map<std::uint32_t, std::shared_ptr<const Preset>> presets_;
+    // last resorts of fallback, null if missing
+    std::shared_ptr<const Preset> percussionPreset_, pianoPreset_;
+    double outputRate_;
     double volume_;
+    std::size_t polyphony_;
+    float absoluteCullingLevel_, relativeCullingLevel_;
+    float busPeak_;
+    RenderContext renderContext_;
+    Governor governor_;
+    std::size_t currentNoteID_;
+    std::vector<float> leftBuffer_, rightBuffer_;
+    // effects are processed once per sub-block on sums of sends of all voices
+    Reverb reverb_;
+    Chorus chorus_;
+    std::vector<float> reverbBuffer_, chorusBuffer_;
+    std::unique_ptr<WorkerPool> workerPool_;
+    SPSCQueue<Event> events_;
+    std::atomic<std::uint64_t> currentFrame_;
+
+    // voices of each channel are split into fixed-size chunks, which idle threads pick up one by one
+    // each task renders into its own buses, and buses are summed in task order
+    // so that output does not depend on number of threads
+    struct RenderTask {
+        std::size_t channelID, beginVoice, endVoice;
+    };
+    std::vector<RenderTask> tasks_;
+    std::vector<float> taskBuffers_;
 
+    void pushEvent(const Event& event);
+    void processEvents();
+    void renderSubBlock(float* left, float* right, std::size_t frames);
+    void renderTask(std::size_t taskID, std::size_t frames);
+    // preallocates tasks and their buses for numVoices voices in total
+    void reserveTasks(std::size_t numVoices);
+    Buses getTaskBuses(std::size_t taskID);
+    std::size_t getPolyphonyLimit() const;
+    void limitPolyphony();
+    std::shared_ptr<const Preset> getPreset(std::uint16_t bank, std::uint16_t presetID) const;
     std::shared_ptr<const Preset> findPreset(std::uint16_t bank, std::uint16_t presetID) const;
     void processChannelMessage(unsigned long param);
 };
@@ -2,23 +2,77 @@
 #include "envelope.h"
 #include "fixed_point.h"
 #include "lfo.h"
+#include "midi.h"
 #include "modulator.h"
 #include "soundfont.h"
 #include "stereo_value.h"
+#include <bitset>
 
 namespace primesynth {
+// number of frames between control-rate updates
+static constexpr unsigned int CALC_INTERVAL = 64;
+
+// control-rate state of a voice
+// per-sample state is owned by VoicePool
 class Voice {
 public:
-    enum class State { Playing, Sustained, Released, Finished };
+    enum class State { Playing, Sustained, Released, Killed, Finished };
+
+    struct RuntimeSample {
+        std::uint32_t start, end, startLoop, endLoop;
+    };
+
+    // entry of a table mapping source controllers or destinations to modulators
+    struct ModulatorRoute {
+        std::uint16_t key;
+        std::uint16_t modulator;
+
+        bool operator<(const ModulatorRoute& b) const {
+            return key < b.key;
+        }
+    };
+
+    // storage of modulators and their routing tables, which is cleared and refilled by each voice using it
+    // VoicePool reuses it for voices created in the same slot, so that note-on allocates no memory once
+    // it has grown large enough
+    struct Buffers {
+        std::vector<Modulator> modulators;
+        std::vector<ModulatorRoute> sourceRoutes, destinationRoutes;
+    };
 
     Voice(std::size_t noteID, double outputRate, const Sample& sample, const GeneratorSet& generators,
-          const ModulatorParameterSet& modparams, std::uint8_t key, std::uint8_t velocity);
+          const ModulatorParameterSet& modparams, std::uint8_t key, std::uint8_t velocity, Buffers& buffers);
 
     std::size_t getNoteID() const;
     std::uint8_t getActualKey() const;
     std::int16_t getExclusiveClass() const;
     const State& getStatus() const;
-    StereoValue render() const;
+    const SampleBuffer& getSampleBuffer() const;
+    const RuntimeSample& getRuntimeSample() const;
+    bool isLooping() const;
+    const FixedPoint& getDeltaIndex() const;
+    double getTargetAmplitude() const;
+    const StereoValue& getVolume() const;
+    // current amplitude given by volume envelope
+    double getEnvelopeAmplitude() const;
+    // whether amplitude given by volume envelope can only decrease from now on
+    bool isDecaying() const;
+    // frames until volume envelope changes its phase, or UINT_MAX if it does not before release
+    unsigned int getFramesUntilPhaseChange() const;
+    // peak amplitude of sample relative to full scale
+    double getSamplePeak() const;
+    // whether voice is rendered through low-pass filter, which is decided at note-on
+    // voices whose filter parameters are modulated by controllers other than note-on ones are always filtered
+    bool isFiltered() const;
+    // filter cutoff frequency relative to output rate
+    double getFilterCutoff() const;
+    // height of resonant peak in centibel
+    double getFilterResonance() const;
+    // fractions of output sent to effects
+    double getReverbSend() const;
+    double getChorusSend() const;
+    // MIDI controllers which modulators of voice depend on
+    const std::bitset<midi::NUM_CONTROLLERS>& getMIDIControllers() const;
 
     void setPercussion(bool percussion);
     void updateSFController(sf::GeneralController controller, double value);
@@ -26,39 +80,52 @@ public:
     void updateFineTuning(double fineTuning);
     void updateCoarseTuning(double coarseTuning);
     void release(bool sustained);
-    void update();
+    // fades out quickly, used for voice stealing
+    void kill();
+    void finish();
+    // advances envelopes and LFOs by frames, and computes targets reached at the end of them
+    void update(unsigned int frames);
 
 private:
     enum class SampleMode { UnLooped, Looped, UnUsed, LoopedUntilRelease };
 
-    struct RuntimeSample {
-        SampleMode mode;
-        double pitch;
-        std::uint32_t start, end, startLoop, endLoop;
-    };
+    using RouteIterator = std::vector<ModulatorRoute>::const_iterator;
 
     const std::size_t noteID_;
+    const double outputRate_;
     const std::uint8_t actualKey_;
-    const std::vector<std::int16_t>& sampleBuffer_;
+    const SampleBuffer& sampleBuffer_;
     GeneratorSet generators_;
+    SampleMode sampleMode_;
+    double samplePitch_;
+    double samplePeak_;
     RuntimeSample rtSample_;
     int keyScaling_;
-    std::vector<Modulator> modulators_;
+    std::vector<Modulator>& modulators_;
+    // indices of modulators sorted by source controller and by destination, built at note-on
+    std::vector<ModulatorRoute>& sourceRoutes_;
+    std::vector<ModulatorRoute>& destinationRoutes_;
+    std::bitset<midi::NUM_CONTROLLERS> midiControllers_;
     double minAtten_;
     std::array<double, NUM_GENERATORS> modulated_;
     bool percussion_;
     double fineTuning_, coarseTuning_;
     double deltaIndexRatio_;
-    unsigned int steps_;
     State status_;
     double voicePitch_;
-    FixedPoint index_, deltaIndex_;
+    FixedPoint deltaIndex_;
+    double targetAmp_;
     StereoValue volume_;
-    double amp_, deltaAmp_;
     Envelope volEnv_, modEnv_;
     LFO vibLFO_, modLFO_;
 
     double getModulatedGenerator(sf::Generator type) const;
+    double getModEnvValue() const;
+    std::pair<RouteIterator, RouteIterator> findRoutes(const std::vector<ModulatorRoute>& routes,
+                                                       std::uint16_t key) const;
+    void buildRoutes();
+    // recomputes each destination affected by a controller once
+    void updateModulatedParams(const std::bitset<NUM_GENERATORS>& destinations);
     void updateModulatedParams(sf::Generator destination);
 };
 }
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace primesynth {
+namespace kernel {
+enum class InstructionSet { Scalar, SSE2, AVX2, AVX512 };
+
+enum class Interpolation {
+    // nearest preceding point
+    None,
+    // 2-point linear
+    Linear,
+    // 4-point cubic Hermite
+    Cubic,
+    // 8-point windowed sinc
+    Sinc
+};
+
+struct MixParams {
+    const std::int16_t* samples;
+    std::size_t numSamples;
+    // 32.32 fixed-point sample index and its increment per frame
+    std::uint64_t index, deltaIndex;
+    // amplitude of the first frame is amp + deltaAmp
+    float amp, deltaAmp;
+    float volumeLeft, volumeRight;
+    // points of loop from loopStart to (loopEnd - 1), which are equal unless looping
+    // points at or after loopEnd are read from the start of loop
+    std::size_t loopStart, loopEnd;
+};
+
+// coefficients of resonant low-pass biquad
+// y[n] = b0 * (x[n] + 2 * x[n - 1] + x[n - 2]) - a1 * y[n - 1] - a2 * y[n - 2]
+struct LowpassCoefficients {
+    float b0, a1, a2;
+};
+
+struct Lowpass {
+    // coefficients of the first frame are coeffs + deltas
+    LowpassCoefficients coeffs, deltas;
+    float x1, x2, y1, y2;
+};
+
+// number of filters processed together, one per SIMD lane
+static constexpr std::size_t FILTER_BANK_WIDTH = 4;
+
+// instruction set selected by CPU feature detection at startup
+InstructionSet getInstructionSet();
+
+// advances index, interpolates and accumulates ramped, panned values into left and right for each frame
+// params are advanced by the number of rendered frames
+// points outside the sample buffer are treated as zero, and points past loop wrap into it
+void mix(MixParams& params, Interpolation interpolation, float* left, float* right, std::size_t frames);
+
+// accumulates ramped values into output without panning
+void mixMono(MixParams& params, Interpolation interpolation, float* output, std::size_t frames);
+
+// advances params as mix() does without rendering
+void skip(MixParams& params, std::size_t frames);
+
+// filters up to FILTER_BANK_WIDTH voices in parallel
+// rows[k] holds frames values of k-th voice, which are replaced by filtered ones
+void filter(Lowpass* const filters[], float* const rows[], std::size_t numFilters, std::size_t frames);
+}
+}
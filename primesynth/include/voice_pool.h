@@ -0,0 +1,133 @@
+#pragma once
+#include "voice.h"
+#include "voice_kernel.h"
+#include <memory>
+#include <type_traits>
+
+namespace primesynth {
+// voices whose estimated peak output falls below these amplitudes are culled
+struct CullingLevels {
+    // decaying voices are finished
+    float finish;
+    // voices keep advancing but are not mixed
+    float freeze;
+};
+
+// limits on rendering quality, which are lowered under CPU load
+struct QualityLimits {
+    kernel::Interpolation interpolation;
+    // frames between control-rate updates, a multiple of CALC_INTERVAL
+    unsigned int controlInterval;
+};
+
+// parameters shared by all voices rendered in a sub-block
+struct RenderContext {
+    // index of the first frame on synthesizer clock
+    std::uint64_t frame;
+    CullingLevels cullingLevels;
+    QualityLimits qualityLimits;
+};
+
+// buses of BLOCK_SIZE frames into which voices are mixed
+struct Buses {
+    float *left, *right;
+    // mono inputs of shared effects
+    float *reverb, *chorus;
+};
+
+// voices of a channel
+// control-rate state is kept in Voice objects, while per-sample state touched by the rendering loop is stored
+// in contiguous structure-of-arrays form indexed by slot
+// voices are constructed in place in preallocated slots, which are recycled after voices finish,
+// so that adding voices allocates no memory as long as reserved capacity suffices
+// control-rate updates of all voices fall on multiples of control interval on synthesizer clock,
+// so that filters of voices can be processed together as banks with shared coefficient ramps
+// extra updates are made where volume envelopes change their phases, which leave filter ramps untouched
+// voices of streamed samples are frozen for intervals in which they would read points that are not ready yet
+class VoicePool {
+public:
+    using Iterator = std::vector<Voice*>::const_iterator;
+
+    VoicePool();
+    ~VoicePool();
+    VoicePool(const VoicePool&) = delete;
+    VoicePool& operator=(const VoicePool&) = delete;
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    void setInterpolation(kernel::Interpolation interpolation);
+    // preallocates slots for capacity voices
+    void reserve(std::size_t capacity);
+    // constructs a voice in a free slot
+    // voice is rendered from next collectActiveVoices() on, so that controllers applied to it before then
+    // take effect from its first frame
+    Voice& add(std::size_t noteID, double outputRate, const Sample& sample, const GeneratorSet& generators,
+               const ModulatorParameterSet& modparams, std::uint8_t key, std::uint8_t velocity);
+    void clear();
+    // collects voices to be rendered in next block and returns number of them
+    std::size_t collectActiveVoices();
+    // renders collected voices from begin-th to (end - 1)-th
+    // different ranges can be rendered concurrently
+    void render(std::size_t begin, std::size_t end, const Buses& buses, std::size_t frames,
+                const RenderContext& context);
+
+private:
+    struct SampleRange {
+        // 32.32 fixed-point
+        std::uint64_t end, startLoop, endLoop;
+    };
+
+    // memory for a voice, kept across voices created in the slot
+    struct Slot {
+        std::aligned_storage_t<sizeof(Voice), alignof(Voice)> storage;
+        Voice::Buffers buffers;
+    };
+
+    kernel::Interpolation interpolation_;
+
+    // cold
+    // slots are allocated one by one, so that voices never move
+    std::vector<std::unique_ptr<Slot>> slots_;
+    // voices constructed in slots in use, which may have finished
+    std::vector<Voice*> voices_;
+    // slots in use whose voices have finished, refilled when it runs out
+    std::vector<std::size_t> freeSlots_;
+    // voices added but not yet started
+    std::vector<std::uint8_t> pending_;
+
+    // hot
+    std::vector<std::uint8_t> active_, looping_, frozen_, filtered_;
+    // path chosen at the start of a sub-block, kept even if effect sends change during it
+    std::vector<std::uint8_t> mono_;
+    // frames until next control-rate update
+    std::vector<unsigned int> countdown_;
+    std::vector<const std::int16_t*> samples_;
+    std::vector<std::size_t> numSamples_;
+    std::vector<SampleStreamer*> streamers_;
+    std::vector<std::uint64_t> index_, deltaIndex_;
+    std::vector<float> amp_, deltaAmp_, volumeLeft_, volumeRight_, reverbVolume_, chorusVolume_;
+    std::vector<SampleRange> ranges_;
+    std::vector<kernel::Lowpass> lowpass_;
+    std::vector<std::size_t> activeSlots_;
+    // a row of CALC_INTERVAL frames for each collected voice
+    // voices which are filtered or feed effects are rendered into their rows in mono, and then mixed into buses
+    std::vector<float> monoBuffer_;
+
+    std::size_t findFreeSlot();
+    // initializes per-sample state of added voice
+    void start(std::size_t slot);
+    bool isRenderedInMono(std::size_t slot) const;
+    void updateVolumes(std::size_t slot, const Voice& voice);
+    // requests points which voice reads in next frames, and returns whether they are ready
+    bool requestSamplePoints(std::size_t slot, unsigned int frames);
+    // offset is number of frames of current sub-block rendered before
+    // filter coefficients are retargeted only at the start of a piece rendered by renderVoice
+    void updateControl(std::size_t slot, std::size_t offset, bool retargetFilter, const RenderContext& context);
+    // renders mono values into left if right is null
+    void renderVoice(std::size_t slot, float* left, float* right, std::size_t offset, std::size_t frames,
+                     const RenderContext& context);
+    void renderMonoVoices(std::size_t begin, std::size_t end, const Buses& buses, std::size_t frames,
+                          const RenderContext& context);
+};
+}
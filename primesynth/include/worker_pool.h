@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace primesynth {
+// persistent threads which execute indexed tasks in parallel
+// idle workers spin for a while before parking on a condition variable
+// tasks are claimed from a word packing generation of run, so that workers lagging behind a finished run
+// never claim tasks of the next one
+class WorkerPool {
+public:
+    using Task = std::function<void(std::size_t)>;
+
+    // calling thread of run() also executes tasks, so numThreads - 1 workers are spawned
+    explicit WorkerPool(std::size_t numThreads);
+    ~WorkerPool();
+
+    std::size_t getNumThreads() const;
+
+    // maximum number of tasks in a run
+    static constexpr std::size_t MAX_TASKS = 0xffff;
+
+    // executes task(0), ..., task(numTasks - 1) and returns after all of them are completed
+    void run(std::size_t numTasks, const Task& task);
+
+private:
+    std::vector<std::thread> threads_;
+    std::atomic_bool running_;
+    std::atomic<std::uint64_t> generation_;
+    std::atomic<const Task*> task_;
+    // generation in upper 32 bits, number of tasks in next 16 bits and index of next task in lower 16 bits
+    std::atomic<std::uint64_t> claim_;
+    std::atomic_size_t remainingTasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    void workerLoop();
+    void executeTasks(std::uint64_t generation);
+};
+}
@@ -4,39 +4,7 @@
 #include <Windows.h>
 
 namespace primesynth {
-int streamCallback(const void*, void* output, unsigned long frameCount, const PaStreamCallbackTimeInfo*,
-                   PaStreamCallbackFlags, void* userData) {
-    const auto out = static_cast<float*>(output);
-    const auto buffer = reinterpret_cast<RingBuffer*>(userData);
-    for (unsigned long i = 0; i < 2 * frameCount; ++i) {
-        out[i] = buffer->empty() ? 0 : buffer->shift();
-    }
-    return PaStreamCallbackResult::paContinue;
-}
-
-void doRenderingLoop(std::atomic_bool& running, const Synthesizer& synth, RingBuffer& buffer, double sampleRate) {
-    static const int UNIT_STEPS = 64;
-    const double stepDuration = UNIT_STEPS / sampleRate;
-
-    double aheadDuration = 0.0;
-    auto lastTime = std::chrono::high_resolution_clock::now();
-    while (running) {
-        for (int i = 0; i < UNIT_STEPS && !buffer.full(); ++i) {
-            const StereoValue sample = synth.render();
-            buffer.push(static_cast<float>(sample.left));
-            buffer.push(static_cast<float>(sample.right));
-        }
-
-        auto now = std::chrono::high_resolution_clock::now();
-        aheadDuration += stepDuration - 2.0 * std::chrono::duration<double>(now - lastTime).count();
-        lastTime = now;
-        aheadDuration = std::max(aheadDuration, 0.0);
-
-        if (aheadDuration > 1.0) {
-            std::this_thread::sleep_for(std::chrono::duration<double>(stepDuration));
-        }
-    }
-}
+static constexpr std::size_t UNIT_STEPS = 64;
 
 void checkPaError(PaError error) {
     if (error != paNoError) {
@@ -46,8 +14,15 @@ void checkPaError(PaError error) {
     }
 }
 
-AudioOutput::AudioOutput(Synthesizer& synth, std::size_t bufferSize, int deviceID, double sampleRate)
-    : buffer_(bufferSize), running_(true) {
+AudioOutput::AudioOutput(Synthesizer& synth, std::size_t bufferSize, int deviceID, double sampleRate,
+                         RenderMode renderMode)
+    : synth_(synth),
+      renderMode_(renderMode),
+      sampleRate_(sampleRate),
+      bufferSize_(bufferSize),
+      buffer_(bufferSize),
+      running_(true),
+      period_(0) {
     PaStreamParameters params = {};
     params.channelCount = 2;
     params.sampleFormat = paFloat32;
@@ -70,15 +45,26 @@ AudioOutput::AudioOutput(Synthesizer& synth, std::size_t bufferSize, int deviceI
            sampleRate);
     SetConsoleOutputCP(cp);
     checkPaError(Pa_OpenStream(&stream_, nullptr, &params, sampleRate, paFramesPerBufferUnspecified, paNoFlag,
-                               streamCallback, &buffer_));
-
-    renderingThread = std::thread(doRenderingLoop, std::ref(running_), std::ref(synth), std::ref(buffer_), sampleRate);
+                               streamCallback, this));
+
+    switch (renderMode_) {
+    case RenderMode::Thread:
+        renderingThread = std::thread(&AudioOutput::doRenderingLoop, this);
+        break;
+    case RenderMode::Ahead:
+        renderingThread = std::thread(&AudioOutput::doRenderingAheadLoop, this);
+        break;
+    case RenderMode::Callback:
+        // rendered in streamCallback
+        break;
+    }
 
     checkPaError(Pa_StartStream(stream_));
 }
 
 AudioOutput::~AudioOutput() {
     running_ = false;
+    cv_.notify_all();
     checkPaError(Pa_StopStream(stream_));
 
     if (renderingThread.joinable()) {
@@ -94,6 +80,85 @@ double AudioOutput::getDefaultSampleRate() {
     return Pa_GetDeviceInfo(getDefaultDeviceID())->defaultSampleRate;
 }
 
+std::size_t AudioOutput::getLatency() const {
+    const auto deviceLatency = static_cast<std::size_t>(Pa_GetStreamInfo(stream_)->outputLatency * sampleRate_);
+    switch (renderMode_) {
+    case RenderMode::Thread:
+        // ring buffer holds interleaved stereo samples
+        return deviceLatency + bufferSize_ / 2;
+    case RenderMode::Ahead:
+        // device latency covers at least one period, and one more period is rendered ahead
+        return 2 * deviceLatency;
+    default:
+        return deviceLatency;
+    }
+}
+
+int AudioOutput::streamCallback(const void*, void* output, unsigned long frameCount, const PaStreamCallbackTimeInfo*,
+                                PaStreamCallbackFlags, void* userData) {
+    const auto out = static_cast<float*>(output);
+    const auto audioOutput = static_cast<AudioOutput*>(userData);
+    if (audioOutput->renderMode_ == RenderMode::Callback) {
+        audioOutput->synth_.renderBlockInterleaved(out, frameCount);
+        return PaStreamCallbackResult::paContinue;
+    }
+
+    const std::size_t numRead = audioOutput->buffer_.read(out, 2 * frameCount);
+    std::fill(out + numRead, out + 2 * frameCount, 0.0f);
+    if (audioOutput->renderMode_ == RenderMode::Ahead) {
+        // notify without locking mutex not to block in callback
+        // lost wakeups are recovered by timeout of rendering thread
+        audioOutput->period_ = frameCount;
+        audioOutput->cv_.notify_one();
+    }
+    return PaStreamCallbackResult::paContinue;
+}
+
+void AudioOutput::doRenderingLoop() {
+    const double stepDuration = UNIT_STEPS / sampleRate_;
+    std::array<float, 2 * UNIT_STEPS> block;
+
+    double aheadDuration = 0.0;
+    auto lastTime = std::chrono::high_resolution_clock::now();
+    while (running_) {
+        const std::size_t frames = std::min(UNIT_STEPS, buffer_.capacity() / 2);
+        if (frames > 0) {
+            synth_.renderBlockInterleaved(block.data(), frames);
+            buffer_.write(block.data(), 2 * frames);
+        }
+
+        auto now = std::chrono::high_resolution_clock::now();
+        aheadDuration += stepDuration - 2.0 * std::chrono::duration<double>(now - lastTime).count();
+        lastTime = now;
+        aheadDuration = std::max(aheadDuration, 0.0);
+
+        if (aheadDuration > 1.0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(stepDuration));
+        }
+    }
+}
+
+void AudioOutput::doRenderingAheadLoop() {
+    std::array<float, 2 * UNIT_STEPS> block;
+
+    while (running_) {
+        // keep one period buffered in addition to the one being played
+        const std::size_t period = period_;
+        while (running_ && buffer_.size() < 2 * period) {
+            const std::size_t frames = std::min(UNIT_STEPS, buffer_.capacity() / 2);
+            if (frames == 0) {
+                break;
+            }
+            synth_.renderBlockInterleaved(block.data(), frames);
+            buffer_.write(block.data(), 2 * frames);
+        }
+
+        std::unique_lock<std::mutex> uniqueLock(mutex_);
+        const double timeout = std::max(period, UNIT_STEPS) / sampleRate_ / 2.0;
+        cv_.wait_for(uniqueLock, std::chrono::duration<double>(timeout));
+    }
+}
+
 static class PortAudioInstance {
 public:
     PortAudioInstance() {
@@ -1,6 +1,10 @@
 #include "channel.h"
 
 namespace primesynth {
+// maximum number of notes sounding on the same key, e.g. when a key is struck repeatedly with sustain pedal
+static constexpr std::size_t MAX_NOTES_PER_KEY = 4;
+static constexpr std::size_t DEFAULT_VOICE_CAPACITY = 128;
+
 Channel::Channel(double outputRate)
     : outputRate_(outputRate),
       controllers_(),
@@ -11,14 +15,13 @@ Channel::Channel(double outputRate)
       dataEntryMode_(DataEntryMode::RPN),
       pitchBendSensitivity_(2.0),
       fineTuning_(0.0),
-      coarseTuning_(0.0),
-      currentNoteID_(0) {
+      coarseTuning_(0.0) {
     controllers_.at(static_cast<std::size_t>(midi::ControlChange::Volume)) = 100;
     controllers_.at(static_cast<std::size_t>(midi::ControlChange::Pan)) = 64;
     controllers_.at(static_cast<std::size_t>(midi::ControlChange::Expression)) = 127;
     controllers_.at(static_cast<std::size_t>(midi::ControlChange::RPNLSB)) = 127;
     controllers_.at(static_cast<std::size_t>(midi::ControlChange::RPNMSB)) = 127;
-    voices_.reserve(128);
+    reserveVoices(DEFAULT_VOICE_CAPACITY);
 }
 
 midi::Bank Channel::getBank() const {
@@ -30,10 +33,23 @@ bool Channel::hasPreset() const {
     return static_cast<bool>(preset_);
 }
 
+const VoicePool& Channel::getVoices() const {
+    return voices_;
+}
+
+std::size_t Channel::getNumVoices() const {
+    std::size_t numVoices = 0;
+    for (const auto& voice : voices_) {
+        if (voice->getStatus() < Voice::State::Killed) {
+            ++numVoices;
+        }
+    }
+    return numVoices;
+}
+
 void Channel::noteOff(std::uint8_t key) {
     const bool sustained = controllers_.at(static_cast<std::size_t>(midi::ControlChange::Sustain)) >= 64;
 
-    std::lock_guard<std::mutex> lockGuard(mutex_);
     for (const auto& voice : voices_) {
         if (voice->getActualKey() == key) {
             voice->release(sustained);
@@ -41,43 +57,31 @@ void Channel::noteOff(std::uint8_t key) {
     }
 }
 
-void Channel::noteOn(std::uint8_t key, std::uint8_t velocity) {
+void Channel::noteOn(std::uint8_t key, std::uint8_t velocity, std::size_t noteID) {
     if (velocity == 0) {
         noteOff(key);
         return;
     }
 
-    for (const Zone& presetZone : preset_->zones) {
-        if (presetZone.isInRange(key, velocity)) {
-            const std::int16_t instID = presetZone.generators.getOrDefault(sf::Generator::Instrument);
-            const auto& inst = preset_->soundFont.getInstruments().at(instID);
-            for (const Zone& instZone : inst.zones) {
-                if (instZone.isInRange(key, velocity)) {
-                    const std::int16_t sampleID = instZone.generators.getOrDefault(sf::Generator::SampleID);
-                    const auto& sample = preset_->soundFont.getSamples().at(sampleID);
-
-                    auto generators = instZone.generators;
-                    generators.add(presetZone.generators);
+    limitNotesPerKey(key);
 
-                    auto modparams = instZone.modulatorParameters;
-                    modparams.mergeAndAdd(presetZone.modulatorParameters);
-                    modparams.merge(ModulatorParameterSet::getDefaultParameters());
-
-                    auto voice = std::make_unique<Voice>(currentNoteID_, outputRate_, sample, generators, modparams,
-                                                         key, velocity);
-                    voice->setPercussion(preset_->bank == PERCUSSION_BANK);
-                    addVoice(std::move(voice));
-                }
-            }
+    const auto voiceTemplates = preset_->getVoiceTemplates(key);
+    for (auto it = voiceTemplates.first; it != voiceTemplates.second; ++it) {
+        const VoiceTemplate& voiceTemplate = **it;
+        if (!voiceTemplate.velocityRange.contains(velocity)) {
+            continue;
         }
+        const auto& sample = preset_->soundFont.getSamples().at(voiceTemplate.sampleID);
+        Voice& voice = voices_.add(noteID, outputRate_, sample, voiceTemplate.generators,
+                                   voiceTemplate.modulatorParameters, key, velocity);
+        voice.setPercussion(preset_->bank == PERCUSSION_BANK);
+        startVoice(voice);
     }
-    ++currentNoteID_;
 }
 
 void Channel::keyPressure(std::uint8_t key, std::uint8_t value) {
     keyPressures_.at(key) = value;
 
-    std::lock_guard<std::mutex> lockGuard(mutex_);
     for (const auto& voice : voices_) {
         if (voice->getActualKey() == key) {
             voice->updateSFController(sf::GeneralController::PolyPressure, value);
@@ -88,7 +92,6 @@ void Channel::keyPressure(std::uint8_t key, std::uint8_t value) {
 void Channel::controlChange(std::uint8_t controller, std::uint8_t value) {
     controllers_.at(controller) = value;
 
-    std::lock_guard<std::mutex> lockGuard(mutex_);
     switch (static_cast<midi::ControlChange>(controller)) {
     case midi::ControlChange::DataEntryMSB:
     case midi::ControlChange::DataEntryLSB:
@@ -165,15 +168,11 @@ void Channel::controlChange(std::uint8_t controller, std::uint8_t value) {
             case midi::ControlChange::RPNLSB:
             case midi::ControlChange::RPNMSB:
                 controllers_.at(i) = 127;
-                for (const auto& voice : voices_) {
-                    voice->updateMIDIController(i, 127);
-                }
+                updateMIDIController(i, 127);
                 break;
             default:
                 controllers_.at(i) = 0;
-                for (const auto& voice : voices_) {
-                    voice->updateMIDIController(i, 0);
-                }
+                updateMIDIController(i, 0);
                 break;
             }
         }
@@ -190,16 +189,13 @@ void Channel::controlChange(std::uint8_t controller, std::uint8_t value) {
         break;
     }
     default:
-        for (const auto& voice : voices_) {
-            voice->updateMIDIController(controller, value);
-        }
+        updateMIDIController(controller, value);
         break;
     }
 }
 
 void Channel::channelPressure(std::uint8_t value) {
     channelPressure_ = value;
-    std::lock_guard<std::mutex> lockGuard(mutex_);
     for (const auto& voice : voices_) {
         voice->updateSFController(sf::GeneralController::ChannelPressure, value);
     }
@@ -207,31 +203,37 @@ void Channel::channelPressure(std::uint8_t value) {
 
 void Channel::pitchBend(std::uint16_t value) {
     pitchBend_ = value;
-    std::lock_guard<std::mutex> lockGuard(mutex_);
     for (const auto& voice : voices_) {
         voice->updateSFController(sf::GeneralController::PitchWheel, value);
     }
 }
 
+void Channel::reserveVoices(std::size_t capacity) {
+    voices_.reserve(capacity);
+    noteIDs_.reserve(capacity);
+}
+
 void Channel::setPreset(const std::shared_ptr<const Preset>& preset) {
     preset_ = preset;
 }
 
-StereoValue Channel::render() {
-    StereoValue sum{0.0, 0.0};
-    std::lock_guard<std::mutex> lockGuard(mutex_);
-    for (const auto& voice : voices_) {
-        if (voice->getStatus() == Voice::State::Finished) {
-            continue;
-        }
-        voice->update();
+void Channel::setInterpolation(kernel::Interpolation interpolation) {
+    voices_.setInterpolation(interpolation);
+}
 
-        if (voice->getStatus() == Voice::State::Finished) {
-            continue;
+std::size_t Channel::collectActiveVoices() {
+    voiceControllers_.reset();
+    for (const auto& voice : voices_) {
+        if (voice->getStatus() != Voice::State::Finished) {
+            voiceControllers_ |= voice->getMIDIControllers();
         }
-        sum += voice->render();
     }
-    return sum;
+    return voices_.collectActiveVoices();
+}
+
+void Channel::render(std::size_t beginVoice, std::size_t endVoice, const Buses& buses, std::size_t frames,
+                     const RenderContext& context) {
+    voices_.render(beginVoice, endVoice, buses, frames, context);
 }
 
 std::uint16_t Channel::getSelectedRPN() const {
@@ -239,35 +241,61 @@ std::uint16_t Channel::getSelectedRPN() const {
                            controllers_.at(static_cast<std::size_t>(midi::ControlChange::RPNLSB)));
 }
 
-void Channel::addVoice(std::unique_ptr<Voice> voice) {
-    voice->updateSFController(sf::GeneralController::PolyPressure, keyPressures_.at(voice->getActualKey()));
-    voice->updateSFController(sf::GeneralController::ChannelPressure, channelPressure_);
-    voice->updateSFController(sf::GeneralController::PitchWheel, pitchBend_);
-    voice->updateSFController(sf::GeneralController::PitchWheelSensitivity, pitchBendSensitivity_);
-    voice->updateFineTuning(fineTuning_);
-    voice->updateCoarseTuning(coarseTuning_);
+void Channel::limitNotesPerKey(std::uint8_t key) {
+    noteIDs_.clear();
+    for (const auto& voice : voices_) {
+        if (voice->getActualKey() == key && voice->getStatus() < Voice::State::Killed) {
+            noteIDs_.push_back(voice->getNoteID());
+        }
+    }
+    std::sort(noteIDs_.begin(), noteIDs_.end());
+    noteIDs_.erase(std::unique(noteIDs_.begin(), noteIDs_.end()), noteIDs_.end());
+    if (noteIDs_.size() < MAX_NOTES_PER_KEY) {
+        return;
+    }
+
+    // kill oldest notes so that the new one fits
+    const std::size_t minNoteID = noteIDs_.at(noteIDs_.size() - MAX_NOTES_PER_KEY);
+    for (const auto& voice : voices_) {
+        if (voice->getActualKey() == key && voice->getNoteID() <= minNoteID) {
+            voice->kill();
+        }
+    }
+}
+
+void Channel::startVoice(Voice& voice) {
+    voice.updateSFController(sf::GeneralController::PolyPressure, keyPressures_.at(voice.getActualKey()));
+    voice.updateSFController(sf::GeneralController::ChannelPressure, channelPressure_);
+    voice.updateSFController(sf::GeneralController::PitchWheel, pitchBend_);
+    voice.updateSFController(sf::GeneralController::PitchWheelSensitivity, pitchBendSensitivity_);
+    voice.updateFineTuning(fineTuning_);
+    voice.updateCoarseTuning(coarseTuning_);
+    const auto& voiceControllers = voice.getMIDIControllers();
     for (std::uint8_t i = 0; i < midi::NUM_CONTROLLERS; ++i) {
-        voice->updateMIDIController(i, controllers_.at(i));
+        if (voiceControllers.test(i)) {
+            voice.updateMIDIController(i, controllers_.at(i));
+        }
     }
+    voiceControllers_ |= voiceControllers;
 
-    const auto exclusiveClass = voice->getExclusiveClass();
+    const auto exclusiveClass = voice.getExclusiveClass();
 
-    std::lock_guard<std::mutex> lockGuard(mutex_);
     if (exclusiveClass != 0) {
         for (const auto& v : voices_) {
-            if (v->getNoteID() != currentNoteID_ && v->getExclusiveClass() == exclusiveClass) {
+            if (v->getNoteID() != voice.getNoteID() && v->getExclusiveClass() == exclusiveClass) {
                 v->release(false);
             }
         }
     }
+}
 
-    for (auto& v : voices_) {
-        if (v->getStatus() == Voice::State::Finished) {
-            v = std::move(voice);
-            return;
-        }
+void Channel::updateMIDIController(std::uint8_t controller, std::uint8_t value) {
+    if (!voiceControllers_.test(controller)) {
+        return;
+    }
+    for (const auto& voice : voices_) {
+        voice->updateMIDIController(controller, value);
     }
-    voices_.emplace_back(std::move(voice));
 }
 
 void Channel::updateRPN() {
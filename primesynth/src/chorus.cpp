@@ -0,0 +1,103 @@
+#include "chorus.h"
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace primesynth {
+// in seconds
+static constexpr double DELAY = 0.012;
+static constexpr double DEPTH = 0.003;
+static constexpr double RATE = 0.4;
+static constexpr float WET_GAIN = 0.5f;
+// frames processed by a vector, which must be shorter than minimum delay
+static constexpr std::size_t WIDTH = 4;
+
+Chorus::Chorus(double outputRate)
+    : position_(0),
+      delay_(static_cast<float>(DELAY * outputRate)),
+      depth_(static_cast<float>(DEPTH * outputRate)),
+      phase_(0.0f),
+      deltaPhase_(static_cast<float>(RATE / outputRate)),
+      silentFrames_(0) {
+    // one extra point is read by interpolation
+    const auto maxDelay = static_cast<std::size_t>(delay_ + depth_) + 2;
+    std::size_t size = 1;
+    while (size <= maxDelay + WIDTH) {
+        size *= 2;
+    }
+    line_.resize(size);
+    mask_ = size - 1;
+}
+
+void Chorus::process(const float* input, float* left, float* right, std::size_t frames) {
+    const bool silent = std::all_of(input, input + frames, [](float x) { return x == 0.0f; });
+    silentFrames_ = silent ? silentFrames_ + frames : 0;
+    // once silence has travelled through the whole line, output is silent too
+    if (silentFrames_ > line_.size() + frames) {
+        return;
+    }
+
+    for (std::size_t i = 0; i < frames; i += WIDTH) {
+        processFrames(input + i, left + i, right + i, std::min(WIDTH, frames - i));
+    }
+}
+
+// triangle wave in [-1, 1] for phase in [0, 1)
+__m128 triangle(__m128 phase) {
+    const __m128 distance = _mm_sub_ps(phase, _mm_set1_ps(0.5f));
+    // absolute value by clearing sign bit
+    const __m128 magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), distance);
+    return _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(4.0f), magnitude));
+}
+
+__m128 wrapPhase(__m128 phase) {
+    return _mm_sub_ps(phase, _mm_cvtepi32_ps(_mm_cvttps_epi32(phase)));
+}
+
+void Chorus::processFrames(const float* input, float* left, float* right, std::size_t frames) {
+    // write first, since taps are delayed by more than WIDTH frames
+    for (std::size_t i = 0; i < frames; ++i) {
+        line_[(position_ + i) & mask_] = input[i];
+    }
+
+    const __m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 phaseLeft = wrapPhase(_mm_add_ps(_mm_set1_ps(phase_), _mm_mul_ps(offsets, _mm_set1_ps(deltaPhase_))));
+    const __m128 phaseRight = wrapPhase(_mm_add_ps(phaseLeft, _mm_set1_ps(0.25f)));
+    // delays relative to each frame, in frames
+    const __m128 delayLeft = _mm_add_ps(_mm_set1_ps(delay_), _mm_mul_ps(_mm_set1_ps(depth_), triangle(phaseLeft)));
+    const __m128 delayRight = _mm_add_ps(_mm_set1_ps(delay_), _mm_mul_ps(_mm_set1_ps(depth_), triangle(phaseRight)));
+    const __m128i integerLeft = _mm_cvttps_epi32(delayLeft);
+    const __m128i integerRight = _mm_cvttps_epi32(delayRight);
+    const __m128 fractionLeft = _mm_sub_ps(delayLeft, _mm_cvtepi32_ps(integerLeft));
+    const __m128 fractionRight = _mm_sub_ps(delayRight, _mm_cvtepi32_ps(integerRight));
+
+    alignas(16) std::int32_t delays[2][WIDTH];
+    _mm_store_si128(reinterpret_cast<__m128i*>(delays[0]), integerLeft);
+    _mm_store_si128(reinterpret_cast<__m128i*>(delays[1]), integerRight);
+    // points at integer delay and one frame older
+    alignas(16) float points[4][WIDTH] = {};
+    for (std::size_t i = 0; i < frames; ++i) {
+        for (std::size_t c = 0; c < 2; ++c) {
+            const std::size_t index = position_ + i - delays[c][i];
+            points[2 * c][i] = line_[index & mask_];
+            points[2 * c + 1][i] = line_[(index - 1) & mask_];
+        }
+    }
+    const __m128 s0Left = _mm_load_ps(points[0]);
+    const __m128 s0Right = _mm_load_ps(points[2]);
+    const __m128 wetLeft = _mm_add_ps(s0Left, _mm_mul_ps(fractionLeft, _mm_sub_ps(_mm_load_ps(points[1]), s0Left)));
+    const __m128 wetRight =
+        _mm_add_ps(s0Right, _mm_mul_ps(fractionRight, _mm_sub_ps(_mm_load_ps(points[3]), s0Right)));
+
+    alignas(16) float wet[2][WIDTH];
+    _mm_store_ps(wet[0], _mm_mul_ps(_mm_set1_ps(WET_GAIN), wetLeft));
+    _mm_store_ps(wet[1], _mm_mul_ps(_mm_set1_ps(WET_GAIN), wetRight));
+    for (std::size_t i = 0; i < frames; ++i) {
+        left[i] += wet[0][i];
+        right[i] += wet[1][i];
+    }
+
+    position_ = (position_ + frames) & mask_;
+    phase_ += frames * deltaPhase_;
+    phase_ -= static_cast<float>(static_cast<int>(phase_));
+}
+}
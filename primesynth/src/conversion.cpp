@@ -1,64 +1,124 @@
 #include "conversion.h"
-#include <array>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 namespace primesynth {
 namespace conv {
-std::array<double, 1441> attenToAmpTable;
-std::array<double, 1200> centToHertzTable;
-
-void initialize() {
-    static bool initialized = false;
-    if (!initialized) {
-        initialized = true;
-
-        for (std::size_t i = 0; i < attenToAmpTable.size(); ++i) {
-            // -200 instead of -100 for compatibility
-            attenToAmpTable.at(i) = std::pow(10.0, i / -200.0);
-        }
-        for (std::size_t i = 0; i < centToHertzTable.size(); i++) {
-            centToHertzTable.at(i) = 6.875 * std::exp2(i / 1200.0);
-        }
+// tables are generated at compile time
+// C++14 has neither constexpr math functions nor mutable constexpr std::array, so series expansions fill a plain
+// array, and tables are kept small to stay within compilers' constexpr evaluation limits
+static constexpr std::size_t TABLE_STEPS = 256;
+
+struct Table {
+    double values[TABLE_STEPS + 1];
+
+    // linear interpolation for x in [0, 1]
+    // x can round to exactly 1, which interpolates within the last step
+    double interpolate(double x) const {
+        const double position = x * TABLE_STEPS;
+        const auto i = std::min(static_cast<std::size_t>(position), TABLE_STEPS - 1);
+        const double r = position - i;
+        return values[i] + r * (values[i + 1] - values[i]);
     }
+};
+
+static constexpr double LN2 = 0.6931471805599453;
+static constexpr double LOG2_10 = 3.321928094887362;
+
+// 2^x for x in [0, 1] by Taylor series of e^(x ln 2)
+constexpr double exp2Series(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 20; ++k) {
+        term *= x * LN2 / k;
+        sum += term;
+    }
+    return sum;
 }
 
-double attenuationToAmplitude(double atten) {
-    if (atten <= 0.0) {
-        return 1.0;
-    } else if (atten >= attenToAmpTable.size()) {
-        return 0.0;
-    } else {
-        return attenToAmpTable.at(static_cast<std::size_t>(atten));
+// log2(x) for x in [1, 2] by series of 2 atanh((x - 1) / (x + 1))
+constexpr double log2Series(double x) {
+    const double z = (x - 1.0) / (x + 1.0);
+    double sum = 0.0;
+    double power = z;
+    for (int k = 0; k < 20; ++k) {
+        sum += power / (2 * k + 1);
+        power *= z * z;
     }
+    return 2.0 * sum / LN2;
 }
 
-double amplitudeToAttenuation(double amp) {
-    return -200.0 * std::log10(amp);
+constexpr Table makeExp2Table() {
+    Table table{};
+    for (std::size_t i = 0; i <= TABLE_STEPS; ++i) {
+        table.values[i] = exp2Series(static_cast<double>(i) / TABLE_STEPS);
+    }
+    return table;
 }
 
-double keyToHertz(double key) {
-    if (key < 0.0) {
-        return 1.0;
+constexpr Table makeLog2Table() {
+    Table table{};
+    for (std::size_t i = 0; i <= TABLE_STEPS; ++i) {
+        table.values[i] = log2Series(1.0 + static_cast<double>(i) / TABLE_STEPS);
     }
+    return table;
+}
 
-    int offset = 300;
-    int ratio = 1;
-    for (int threshold = 900; threshold <= 14100; threshold += 1200) {
-        if (key * 100.0 < threshold) {
-            return ratio * centToHertzTable.at(static_cast<int>(key * 100.0) + offset);
-        }
-        offset -= 1200;
-        ratio *= 2;
+static constexpr Table exp2Table = makeExp2Table();
+static constexpr Table log2Table = makeLog2Table();
+
+double exp2(double x) {
+    // integer part goes directly into exponent bits, and fractional part is looked up
+    x = std::max(-1022.0, std::min(1023.0, x));
+    const auto truncated = static_cast<std::int64_t>(x);
+    const std::int64_t integer = truncated - (x < truncated);
+    const std::uint64_t bits = static_cast<std::uint64_t>(integer + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return scale * exp2Table.interpolate(x - integer);
+}
+
+double log2(double x) {
+    if (!(x >= std::numeric_limits<double>::min())) {
+        return -std::numeric_limits<double>::infinity();
     }
+    // exponent bits give integer part, and mantissa in [1, 2) is looked up
+    std::uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    const auto exponent = static_cast<std::int64_t>(bits >> 52) - 1023;
+    bits = (bits & 0xfffffffffffffull) | (1023ull << 52);
+    double mantissa;
+    std::memcpy(&mantissa, &bits, sizeof(mantissa));
+    return exponent + log2Table.interpolate(mantissa - 1.0);
+}
+
+double attenuationToAmplitude(double atten) {
+    // -200 instead of -100 for compatibility
+    static constexpr double MAX_ATTENUATION = 1441.0;
+    const double amp = exp2(std::max(0.0, atten) * (-LOG2_10 / 200.0));
+    return atten < MAX_ATTENUATION ? amp : 0.0;
+}
 
-    return 1.0;
+double amplitudeToAttenuation(double amp) {
+    return -200.0 / LOG2_10 * log2(amp);
+}
+
+double keyToHertz(double key) {
+    if (key < 0.0 || key >= 141.0) {
+        return 1.0;
+    }
+    // frequency of key 0
+    static constexpr double BASE = 8.175798915643707;
+    return BASE * exp2(key / 12.0);
 }
 
 double timecentToSecond(double tc) {
-    return std::exp2(tc / 1200.0);
+    return exp2(tc / 1200.0);
 }
 
 double absoluteCentToHertz(double ac) {
-    return 8.176 * std::exp2(ac / 1200.0);
+    return 8.176 * exp2(ac / 1200.0);
 }
 
 double concave(double x) {
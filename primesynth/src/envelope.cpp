@@ -2,8 +2,8 @@
 #include "envelope.h"
 
 namespace primesynth {
-Envelope::Envelope(double outputRate, unsigned int interval)
-    : effectiveOutputRate_(outputRate / interval), params_(), phase_(Phase::Delay), phaseSteps_(0), value_(1.0) {}
+Envelope::Envelope(double outputRate)
+    : outputRate_(outputRate), params_(), phase_(Phase::Delay), phaseFrames_(0.0), value_(0.0), releaseValue_(0.0) {}
 
 Envelope::Phase Envelope::getPhase() const {
     return phase_;
@@ -13,11 +13,24 @@ double Envelope::getValue() const {
     return value_;
 }
 
+unsigned int Envelope::getFramesUntilPhaseChange() const {
+    if (phase_ == Phase::Sustain || phase_ == Phase::Finished) {
+        return UINT_MAX;
+    }
+    const double remaining = std::ceil(getPhaseLength() - phaseFrames_);
+    return remaining < UINT_MAX ? std::max(1u, static_cast<unsigned int>(remaining)) : UINT_MAX;
+}
+
 void Envelope::setParameter(Phase phase, double param) {
     if (phase == Phase::Sustain) {
         params_.at(static_cast<std::size_t>(Phase::Sustain)) = 1.0 - 0.001 * param;
     } else if (phase < Phase::Finished) {
-        params_.at(static_cast<std::size_t>(phase)) = effectiveOutputRate_ * conv::timecentToSecond(param);
+        params_.at(static_cast<std::size_t>(phase)) = outputRate_ * conv::timecentToSecond(param);
+        if (phase == Phase::Release && phase_ == Phase::Release) {
+            // continue from current value with new slope
+            releaseValue_ = value_;
+            phaseFrames_ = 0.0;
+        }
     } else {
         throw std::invalid_argument("unknown phase");
     }
@@ -25,20 +38,25 @@ void Envelope::setParameter(Phase phase, double param) {
 
 void Envelope::release() {
     if (phase_ < Phase::Release) {
+        releaseValue_ = value_;
         changePhase(Phase::Release);
     }
 }
 
-void Envelope::update() {
+void Envelope::update(unsigned int frames) {
     if (phase_ == Phase::Finished) {
         return;
     }
 
-    ++phaseSteps_;
-
-    auto i = static_cast<std::size_t>(phase_);
-    while (phase_ < Phase::Finished && phase_ != Phase::Sustain && phaseSteps_ >= params_.at(i)) {
-        changePhase(static_cast<Phase>(++i));
+    // carry frames over phase boundaries
+    phaseFrames_ += frames;
+    while (phase_ != Phase::Sustain && phase_ != Phase::Finished) {
+        const double length = getPhaseLength();
+        if (phaseFrames_ < length) {
+            break;
+        }
+        phaseFrames_ -= length;
+        changePhase(static_cast<Phase>(static_cast<int>(phase_) + 1));
     }
 
     const double& sustain = params_.at(static_cast<std::size_t>(Phase::Sustain));
@@ -48,35 +66,40 @@ void Envelope::update() {
         value_ = 0.0;
         return;
     case Phase::Attack:
-        value_ = phaseSteps_ / params_.at(i);
+        value_ = phaseFrames_ / params_.at(static_cast<std::size_t>(Phase::Attack));
         return;
     case Phase::Hold:
         value_ = 1.0;
         return;
     case Phase::Decay:
-        value_ = 1.0 - phaseSteps_ / params_.at(i);
-        if (value_ <= sustain) {
-            value_ = sustain;
-            changePhase(Phase::Sustain);
-        }
+        value_ = 1.0 - phaseFrames_ / params_.at(static_cast<std::size_t>(Phase::Decay));
         return;
     case Phase::Sustain:
         value_ = sustain;
         return;
     case Phase::Release:
-        value_ -= 1.0 / params_.at(i);
-        if (value_ <= 0.0) {
-            value_ = 0.0;
-            changePhase(Phase::Finished);
-        }
+        value_ = releaseValue_ - phaseFrames_ / params_.at(static_cast<std::size_t>(Phase::Release));
         return;
     }
 
     throw std::logic_error("unreachable");
 }
 
+double Envelope::getPhaseLength() const {
+    const double& length = params_.at(static_cast<std::size_t>(phase_));
+    switch (phase_) {
+    case Phase::Decay:
+        // ends when value reaches sustain level
+        return length * (1.0 - params_.at(static_cast<std::size_t>(Phase::Sustain)));
+    case Phase::Release:
+        return length * releaseValue_;
+    default:
+        return length;
+    }
+}
+
 void Envelope::changePhase(Phase phase) {
     phase_ = phase;
-    phaseSteps_ = 0;
+    phaseFrames_ = 0.0;
 }
 }
@@ -0,0 +1,65 @@
+#include "governor.h"
+
+namespace primesynth {
+// smoothing factor of exponential moving average of load
+static constexpr double LOAD_SMOOTHING = 0.2;
+static constexpr double HIGH_LOAD = 0.8;
+static constexpr double LOW_LOAD = 0.4;
+// level is kept for a while after each change so that its effect on load can be observed
+static constexpr double HOLD_TIME = 0.05;
+// load must stay low for this time before level is raised
+static constexpr double RECOVERY_TIME = 2.0;
+
+// from highest to lowest quality
+// interpolation of each level is an upper limit, and channels set to lower interpolation keep it
+static const std::array<Governor::Level, 5> LEVELS = {{
+    {{kernel::Interpolation::Sinc, CALC_INTERVAL}, 1.0},
+    {{kernel::Interpolation::Cubic, CALC_INTERVAL}, 1.0},
+    {{kernel::Interpolation::Linear, CALC_INTERVAL}, 1.0},
+    {{kernel::Interpolation::Linear, 2 * CALC_INTERVAL}, 0.75},
+    {{kernel::Interpolation::None, 4 * CALC_INTERVAL}, 0.5},
+}};
+
+Governor::Governor() : enabled_(false), level_(0), load_(0.0), holdTime_(0.0), lowLoadTime_(0.0) {}
+
+void Governor::setEnabled(bool enabled) {
+    enabled_ = enabled;
+    level_ = 0;
+    load_ = 0.0;
+    holdTime_ = 0.0;
+    lowLoadTime_ = 0.0;
+}
+
+const Governor::Level& Governor::getLevel() const {
+    return LEVELS.at(level_);
+}
+
+bool Governor::update(double renderTime, double realTime) {
+    if (!enabled_ || realTime <= 0.0) {
+        return false;
+    }
+
+    load_ += LOAD_SMOOTHING * (renderTime / realTime - load_);
+    holdTime_ = std::max(0.0, holdTime_ - realTime);
+
+    if (load_ > HIGH_LOAD) {
+        lowLoadTime_ = 0.0;
+        if (holdTime_ == 0.0 && level_ + 1 < LEVELS.size()) {
+            ++level_;
+            holdTime_ = HOLD_TIME;
+            return true;
+        }
+    } else if (load_ < LOW_LOAD) {
+        lowLoadTime_ += realTime;
+        if (lowLoadTime_ >= RECOVERY_TIME && level_ > 0) {
+            --level_;
+            lowLoadTime_ = 0.0;
+            holdTime_ = HOLD_TIME;
+            return true;
+        }
+    } else {
+        lowLoadTime_ = 0.0;
+    }
+    return false;
+}
+}
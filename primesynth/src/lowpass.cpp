@@ -0,0 +1,54 @@
+#include "lowpass.h"
+#include <array>
+
+namespace primesynth {
+// cutoff is clamped below Nyquist frequency to keep the filter stable
+static constexpr double MAX_CUTOFF = 0.45;
+static constexpr std::size_t NUM_CUTOFF_STEPS = 1024;
+static constexpr double MAX_RESONANCE = 960.0;
+
+struct CutoffEntry {
+    double cos, sin;
+};
+
+// entry i holds cosine and sine of angular frequency for cutoff i / NUM_CUTOFF_STEPS * 0.5
+std::array<CutoffEntry, NUM_CUTOFF_STEPS + 1> makeCutoffTable() {
+    static constexpr double PI = 3.141592653589793;
+    std::array<CutoffEntry, NUM_CUTOFF_STEPS + 1> table;
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        const double omega = PI * i / NUM_CUTOFF_STEPS;
+        table.at(i) = {std::cos(omega), std::sin(omega)};
+    }
+    return table;
+}
+
+// entry i holds 1 / 2Q for resonance of i centibel
+std::array<double, static_cast<std::size_t>(MAX_RESONANCE) + 1> makeResonanceTable() {
+    std::array<double, static_cast<std::size_t>(MAX_RESONANCE) + 1> table;
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        // 3.01 dB is subtracted so that zero resonance gives Butterworth response without peak
+        const double q = std::pow(10.0, (i - 30.1) / 200.0);
+        table.at(i) = 0.5 / q;
+    }
+    return table;
+}
+
+static const auto cutoffTable = makeCutoffTable();
+static const auto resonanceTable = makeResonanceTable();
+
+kernel::LowpassCoefficients calculateLowpass(double cutoff, double resonance) {
+    const double position = 2.0 * NUM_CUTOFF_STEPS * std::max(0.0, std::min(MAX_CUTOFF, cutoff));
+    const auto i = static_cast<std::size_t>(position);
+    const double r = position - i;
+    const CutoffEntry& e0 = cutoffTable.at(i);
+    const CutoffEntry& e1 = cutoffTable.at(i + 1);
+    const double cos = e0.cos + r * (e1.cos - e0.cos);
+    const double sin = e0.sin + r * (e1.sin - e0.sin);
+
+    const double alpha =
+        sin * resonanceTable.at(static_cast<std::size_t>(std::max(0.0, std::min(MAX_RESONANCE, resonance))));
+    const double a0 = 1.0 + alpha;
+    return {static_cast<float>(0.5 * (1.0 - cos) / a0), static_cast<float>(-2.0 * cos / a0),
+            static_cast<float>((1.0 - alpha) / a0)};
+}
+}
@@ -15,6 +15,18 @@ int main(int argc, char** argv) {
         argparser.add<double>("samplerate", 's', "sample rate (Hz)", false);
         argparser.add<unsigned int>("buffer", 'b', "audio output buffer size", false, 1 << 12);
         argparser.add<unsigned int>("channels", 'c', "number of MIDI channels", false, 16);
+        argparser.add<unsigned int>("threads", 't', "number of rendering threads", false, 1);
+        argparser.add<unsigned int>("polyphony", '\0', "maximum number of voices (0 = unlimited)", false, 256);
+        argparser.add<double>("cull-abs", '\0', "culling threshold (dB, 0 = disabled)", false, -120.0);
+        argparser.add<double>("cull-rel", '\0', "culling threshold relative to mix peak (dB, 0 = disabled)", false,
+                              0.0);
+        argparser.add<std::string>("interp", '\0', "interpolation (none, linear, cubic, sinc)", false, "linear",
+                                   cmdline::oneof<std::string>("none", "linear", "cubic", "sinc"));
+        argparser.add("governor", '\0', "lower quality automatically when rendering cannot keep up");
+        argparser.add<std::string>("samples", '\0', "loading of SoundFont sample data (read, map, stream)", false,
+                                   "read", cmdline::oneof<std::string>("read", "map", "stream"));
+        argparser.add<std::string>("render", 'r', "rendering mode (thread, callback, ahead)", false, "thread",
+                                   cmdline::oneof<std::string>("thread", "callback", "ahead"));
         argparser.add<std::string>("std", '\0', "MIDI standard, affects bank selection (gm, gs, xg)", false, "gs",
                                    cmdline::oneof<std::string>("gm", "gs", "xg"));
         argparser.add("fix-std", '\0', "do not respond to GM/XG System On, GS Reset, etc.");
@@ -35,19 +47,48 @@ int main(int argc, char** argv) {
             midiStandard = midi::Standard::XG;
         }
 
+        auto interpolation = kernel::Interpolation::Linear;
+        if (argparser.get<std::string>("interp") == "none") {
+            interpolation = kernel::Interpolation::None;
+        } else if (argparser.get<std::string>("interp") == "cubic") {
+            interpolation = kernel::Interpolation::Cubic;
+        } else if (argparser.get<std::string>("interp") == "sinc") {
+            interpolation = kernel::Interpolation::Sinc;
+        }
+
+        auto sampleLoading = SampleLoading::Read;
+        if (argparser.get<std::string>("samples") == "map") {
+            sampleLoading = SampleLoading::Map;
+        } else if (argparser.get<std::string>("samples") == "stream") {
+            sampleLoading = SampleLoading::Stream;
+        }
+
+        auto renderMode = AudioOutput::RenderMode::Thread;
+        if (argparser.get<std::string>("render") == "callback") {
+            renderMode = AudioOutput::RenderMode::Callback;
+        } else if (argparser.get<std::string>("render") == "ahead") {
+            renderMode = AudioOutput::RenderMode::Ahead;
+        }
+
         Synthesizer synth(sampleRate, argparser.get<unsigned int>("channels"));
         synth.setMIDIStandard(midiStandard, argparser.exist("fix-std"));
         synth.setVolume(argparser.get<double>("volume"));
+        synth.setNumThreads(argparser.get<unsigned int>("threads"));
+        synth.setPolyphony(argparser.get<unsigned int>("polyphony"));
+        synth.setCullingThresholds(argparser.get<double>("cull-abs"), argparser.get<double>("cull-rel"));
+        synth.setInterpolation(interpolation);
+        synth.setGovernorEnabled(argparser.exist("governor"));
         for (const std::string& filename : argparser.rest()) {
             std::cout << "loading " << filename << std::endl;
-            synth.loadSoundFont(filename);
+            synth.loadSoundFont(filename, sampleLoading);
         }
 
-        MIDIInput midiInput(synth, argparser.get<unsigned int>("in"), argparser.exist("print-msg"));
         AudioOutput audioOutput(synth, argparser.get<unsigned int>("buffer"),
                                 argparser.exist("out") ? argparser.get<unsigned int>("out")
                                                        : AudioOutput::getDefaultDeviceID(),
-                                sampleRate);
+                                sampleRate, renderMode);
+        MIDIInput midiInput(synth, argparser.get<unsigned int>("in"), audioOutput.getLatency(),
+                            argparser.exist("print-msg"));
 
         SetPriorityClass(GetCurrentProcess(), REALTIME_PRIORITY_CLASS);
 
@@ -0,0 +1,109 @@
+#include "mapped_file.h"
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace primesynth {
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filename) : data_(nullptr), size_(0) {
+    const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("failed to open file");
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 ||
+        static_cast<unsigned long long>(size.QuadPart) > SIZE_MAX) {
+        CloseHandle(file);
+        throw std::runtime_error("failed to map file");
+    }
+
+    // the view keeps mapping and file open
+    const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        throw std::runtime_error("failed to map file");
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) {
+        throw std::runtime_error("failed to map file");
+    }
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<std::size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(data_);
+}
+
+void MappedFile::prefetch(std::size_t offset, std::size_t size) const {
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+    WIN32_MEMORY_RANGE_ENTRY range{const_cast<char*>(data_ + offset), std::min(size, size_ - offset)};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
+
+bool MappedFile::lock(std::size_t offset, std::size_t size) const {
+    return VirtualLock(const_cast<char*>(data_ + offset), std::min(size, size_ - offset)) != FALSE;
+}
+
+void MappedFile::unlock(std::size_t offset, std::size_t size) const {
+    VirtualUnlock(const_cast<char*>(data_ + offset), std::min(size, size_ - offset));
+}
+#else
+MappedFile::MappedFile(const std::string& filename) : data_(nullptr), size_(0) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open file");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("failed to map file");
+    }
+
+    // the mapping keeps file open
+    void* const data = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("failed to map file");
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = static_cast<std::size_t>(st.st_size);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+void MappedFile::prefetch(std::size_t offset, std::size_t size) const {
+    // madvise requires page-aligned address
+    const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t begin = offset / pageSize * pageSize;
+    const std::size_t end = std::min(size_, offset + size);
+    madvise(const_cast<char*>(data_ + begin), end - begin, MADV_WILLNEED);
+}
+
+bool MappedFile::lock(std::size_t offset, std::size_t size) const {
+    return mlock(data_ + offset, std::min(size, size_ - offset)) == 0;
+}
+
+void MappedFile::unlock(std::size_t offset, std::size_t size) const {
+    munlock(data_ + offset, std::min(size, size_ - offset));
+}
+#endif
+
+const char* MappedFile::getData() const {
+    return data_;
+}
+
+std::size_t MappedFile::getSize() const {
+    return size_;
+}
+}
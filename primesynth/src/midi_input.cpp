@@ -14,7 +14,23 @@ void checkMMResult(MMRESULT result) {
     }
 }
 
-void CALLBACK MidiInProc(HMIDIIN, UINT wMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD) {
+// converts timestamp (milliseconds since midiInStart) to frame of synthesizer clock
+std::uint64_t toSynthesizerTime(MIDIInput::SharedParam& sp, DWORD timestamp) {
+    const auto now = static_cast<std::int64_t>(sp.synth.getCurrentFrame());
+    const auto latency = static_cast<std::int64_t>(sp.latency);
+    const auto elapsed = static_cast<std::int64_t>(timestamp * sp.synth.getOutputRate() / 1000.0);
+    std::int64_t time = sp.timeOffset + elapsed;
+
+    // re-anchor when event would be late or too far ahead, e.g. when audio output glitched or clocks drifted
+    if (!sp.anchored || time < now || time > now + 2 * latency) {
+        sp.timeOffset = now + latency - elapsed;
+        sp.anchored = true;
+        time = now + latency;
+    }
+    return static_cast<std::uint64_t>(time);
+}
+
+void CALLBACK MidiInProc(HMIDIIN, UINT wMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD dwParam2) {
     const auto sp = reinterpret_cast<MIDIInput::SharedParam*>(dwInstance);
     if (!sp->running) {
         return;
@@ -22,11 +38,11 @@ void CALLBACK MidiInProc(HMIDIIN, UINT wMsg, DWORD_PTR dwInstance, DWORD_PTR dwP
 
     switch (wMsg) {
     case MIM_DATA:
-        sp->synth.processShortMessage(static_cast<std::uint32_t>(dwParam1));
+        sp->synth.processShortMessage(static_cast<std::uint32_t>(dwParam1), toSynthesizerTime(*sp, dwParam2));
         break;
     case MIM_LONGDATA: {
         const auto mh = reinterpret_cast<LPMIDIHDR>(dwParam1);
-        sp->synth.processSysEx(mh->lpData, mh->dwBytesRecorded);
+        sp->synth.processSysEx(mh->lpData, mh->dwBytesRecorded, toSynthesizerTime(*sp, dwParam2));
 
         // See "MidiInProc callback function" (https://msdn.microsoft.com/en-us/library/dd798460.aspx)
         // "Applications should not call any multimedia functions from inside the callback function, as doing so can
@@ -97,8 +113,8 @@ void CALLBACK verboseMidiInProc(HMIDIIN hmi, UINT wMsg, DWORD_PTR dwInstance, DW
     MidiInProc(hmi, wMsg, dwInstance, dwParam1, dwParam2);
 }
 
-MIDIInput::MIDIInput(Synthesizer& synth, UINT deviceID, bool verbose)
-    : sysExBuffer_(512), mh_(), sharedParam_{synth, true, false} {
+MIDIInput::MIDIInput(Synthesizer& synth, UINT deviceID, std::size_t latency, bool verbose)
+    : sysExBuffer_(512), mh_(), sharedParam_{synth, true, false, {}, {}, latency, false, 0} {
     MIDIINCAPS caps;
     checkMMResult(midiInGetDevCaps(deviceID, &caps, sizeof(caps)));
     std::wcout << "MIDI: opening " << caps.szPname << std::endl;
@@ -9,6 +9,14 @@ sf::Generator Modulator::getDestination() const {
     return param_.modDestOper;
 }
 
+const sf::Modulator& Modulator::getSource() const {
+    return param_.modSrcOper;
+}
+
+const sf::Modulator& Modulator::getAmountSource() const {
+    return param_.modAmtSrcOper;
+}
+
 std::int16_t Modulator::getAmount() const {
     return param_.modAmount;
 }
@@ -0,0 +1,106 @@
+#include "reverb.h"
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace primesynth {
+// mutually prime lengths at 44.1 kHz, so that echoes of lines do not pile up
+static constexpr std::array<double, 8> DELAYS = {1117, 1277, 1399, 1523, 1777, 1913, 2131, 2371};
+static constexpr double DECAY_TIME = 1.8;
+// coefficient of one-pole low-pass on each line, higher values darken the tail faster
+static constexpr float DAMPING = 0.3f;
+static constexpr float INPUT_GAIN = 0.25f;
+static constexpr float OUTPUT_GAIN = 0.3f;
+// tail below this amplitude is discarded
+static constexpr float IDLE_LEVEL = 1e-6f;
+
+Reverb::Reverb(double outputRate)
+    : position_(0), damped_(), idle_(true), windowFrames_(0), silentFrames_(0), windowPeak_(0.0f) {
+    std::size_t size = 1;
+    for (std::size_t i = 0; i < NUM_LINES; ++i) {
+        delays_.at(i) = static_cast<std::size_t>(DELAYS.at(i) * outputRate / 44100.0);
+        while (size <= delays_.at(i)) {
+            size *= 2;
+        }
+        // decay by 60 dB in DECAY_TIME, with normalization of 8x8 Hadamard matrix
+        gains_.at(i) = static_cast<float>(std::pow(10.0, -3.0 * delays_.at(i) / (DECAY_TIME * outputRate)) /
+                                          std::sqrt(static_cast<double>(NUM_LINES)));
+    }
+    lines_.resize(NUM_LINES * size);
+    mask_ = size - 1;
+}
+
+// 4-point Hadamard transform within a vector
+__m128 hadamard4(__m128 x) {
+    const __m128 pairs = _mm_add_ps(_mm_mul_ps(x, _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f)),
+                                    _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(_mm_mul_ps(pairs, _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f)),
+                      _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+void Reverb::process(const float* input, float* left, float* right, std::size_t frames) {
+    const bool silent = std::all_of(input, input + frames, [](float x) { return x == 0.0f; });
+    if (silent && idle_) {
+        return;
+    }
+    idle_ = false;
+
+    // lines 0-3 are held in a, and lines 4-7 in b
+    const __m128 gainA = _mm_load_ps(gains_.data());
+    const __m128 gainB = _mm_load_ps(gains_.data() + 4);
+    const __m128 damping = _mm_set1_ps(DAMPING);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 inputSigns = _mm_setr_ps(INPUT_GAIN, -INPUT_GAIN, INPUT_GAIN, -INPUT_GAIN);
+    const __m128 outputSigns = _mm_setr_ps(OUTPUT_GAIN, -OUTPUT_GAIN, -OUTPUT_GAIN, OUTPUT_GAIN);
+    __m128 dampedA = _mm_load_ps(damped_.data());
+    __m128 dampedB = _mm_load_ps(damped_.data() + 4);
+
+    __m128 peak = _mm_setzero_ps();
+    for (std::size_t i = 0; i < frames; ++i) {
+        std::array<float, NUM_LINES> outputs;
+        for (std::size_t j = 0; j < NUM_LINES; ++j) {
+            outputs[j] = lines_[NUM_LINES * ((position_ - delays_[j]) & mask_) + j];
+        }
+        const __m128 a = _mm_loadu_ps(outputs.data());
+        const __m128 b = _mm_loadu_ps(outputs.data() + 4);
+        dampedA = _mm_add_ps(a, _mm_mul_ps(damping, _mm_sub_ps(dampedA, a)));
+        dampedB = _mm_add_ps(b, _mm_mul_ps(damping, _mm_sub_ps(dampedB, b)));
+        // absolute values by clearing sign bits
+        peak = _mm_max_ps(peak, _mm_max_ps(_mm_andnot_ps(signBit, a), _mm_andnot_ps(signBit, b)));
+
+        // left takes lines 0-3 and right takes lines 4-7, with alternating signs
+        const __m128 tapsLeft = _mm_mul_ps(dampedA, outputSigns);
+        const __m128 tapsRight = _mm_mul_ps(dampedB, outputSigns);
+        const __m128 sums = _mm_add_ps(_mm_unpacklo_ps(tapsLeft, tapsRight), _mm_unpackhi_ps(tapsLeft, tapsRight));
+        alignas(16) float wet[4];
+        _mm_store_ps(wet, _mm_add_ps(sums, _mm_movehl_ps(sums, sums)));
+        left[i] += wet[0];
+        right[i] += wet[1];
+
+        // 8-point Hadamard transform as butterflies of two 4-point ones
+        const __m128 ha = hadamard4(dampedA);
+        const __m128 hb = hadamard4(dampedB);
+        const __m128 in = _mm_mul_ps(_mm_set1_ps(input[i]), inputSigns);
+        float* const line = lines_.data() + NUM_LINES * position_;
+        _mm_storeu_ps(line, _mm_add_ps(_mm_mul_ps(gainA, _mm_add_ps(ha, hb)), in));
+        _mm_storeu_ps(line + 4, _mm_add_ps(_mm_mul_ps(gainB, _mm_sub_ps(ha, hb)), in));
+        position_ = (position_ + 1) & mask_;
+    }
+    _mm_store_ps(damped_.data(), dampedA);
+    _mm_store_ps(damped_.data() + 4, dampedB);
+
+    alignas(16) float peaks[4];
+    _mm_store_ps(peaks, peak);
+    windowPeak_ = std::max({windowPeak_, peaks[0], peaks[1], peaks[2], peaks[3]});
+    windowFrames_ += frames;
+    silentFrames_ = silent ? silentFrames_ + frames : 0;
+    if (windowFrames_ > mask_) {
+        idle_ = silentFrames_ >= windowFrames_ && windowPeak_ < IDLE_LEVEL;
+        if (idle_) {
+            std::fill(lines_.begin(), lines_.end(), 0.0f);
+            damped_ = {};
+        }
+        windowFrames_ = 0;
+        windowPeak_ = 0.0f;
+    }
+}
+}
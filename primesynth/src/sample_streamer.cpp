@@ -0,0 +1,151 @@
+#include "sample_streamer.h"
+#include <algorithm>
+#include <chrono>
+
+namespace primesynth {
+// number of blocks requested beyond the range a voice is about to read
+static constexpr std::size_t AHEAD_BLOCKS = 2;
+// reading a byte in every 4 KiB touches all pages for any page size
+static constexpr std::size_t PAGE_STRIDE = 4096;
+// blocks not requested during a whole interval are evicted
+static constexpr auto EVICTION_INTERVAL = std::chrono::seconds(1);
+
+SampleStreamer::SampleStreamer(const MappedFile& file, std::size_t offset, std::size_t size)
+    : file_(file),
+      offset_(offset),
+      size_(size),
+      firstBlock_(offset / BLOCK_SIZE),
+      states_(size > 0 ? (offset + size * sizeof(std::int16_t) - 1) / BLOCK_SIZE - firstBlock_ + 1 : 0),
+      lastRequests_(states_.size()),
+      epoch_(0),
+      running_(true) {
+    requests_.reserve(states_.size());
+    thread_ = std::thread(&SampleStreamer::streamerLoop, this);
+}
+
+SampleStreamer::~SampleStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    requested_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SampleStreamer::preload(std::size_t begin, std::size_t end) {
+    end = std::min(end, size_);
+    if (begin >= end) {
+        return;
+    }
+    for (std::size_t block = getBlock(begin); block <= getBlock(end - 1); ++block) {
+        if (states_[block] != Preloaded) {
+            read(block);
+            // a queued request for the block is skipped by streamer thread, and preloaded blocks are never evicted
+            states_[block] = Preloaded;
+        }
+    }
+}
+
+bool SampleStreamer::request(std::size_t begin, std::size_t end) {
+    end = std::min(end, size_);
+    if (begin >= end) {
+        return true;
+    }
+    const std::size_t lastBlock = getBlock(end - 1);
+    const std::size_t lastRequested = std::min(lastBlock + AHEAD_BLOCKS, states_.size() - 1);
+    const std::uint32_t epoch = epoch_.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    bool ready = true;
+    for (std::size_t block = getBlock(begin); block <= lastRequested; ++block) {
+        lastRequests_[block].store(epoch, std::memory_order_relaxed);
+        std::uint8_t state = states_[block].load(std::memory_order_acquire);
+        if (state >= Ready) {
+            continue;
+        }
+        if (block <= lastBlock) {
+            ready = false;
+        }
+        // only the caller which turns a block Requested queues it, so that the lock is rarely taken
+        if (state == Idle && states_[block].compare_exchange_strong(state, Requested)) {
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+            requests_.push_back(block);
+        }
+    }
+    if (lock.owns_lock()) {
+        lock.unlock();
+        requested_.notify_one();
+    }
+    return ready;
+}
+
+std::size_t SampleStreamer::getBlock(std::size_t point) const {
+    return (offset_ + point * sizeof(std::int16_t)) / BLOCK_SIZE - firstBlock_;
+}
+
+void SampleStreamer::read(std::size_t block) const {
+    // locking reads pages in and keeps them from being paged out until the block is evicted
+    const std::size_t offset = (firstBlock_ + block) * BLOCK_SIZE;
+    if (file_.lock(offset, BLOCK_SIZE)) {
+        return;
+    }
+
+    // beyond the limit of locked memory, pages are only made resident in page cache
+    const auto bytes = reinterpret_cast<const volatile char*>(file_.getData() + offset);
+    const std::size_t size = std::min(BLOCK_SIZE, file_.getSize() - offset);
+    char sum = 0;
+    for (std::size_t i = 0; i < size; i += PAGE_STRIDE) {
+        sum ^= bytes[i];
+    }
+    static_cast<void>(sum);
+}
+
+void SampleStreamer::evict() {
+    const std::uint32_t epoch = epoch_++;
+    for (std::size_t block = 0; block < states_.size(); ++block) {
+        if (lastRequests_[block].load(std::memory_order_relaxed) == epoch) {
+            continue;
+        }
+        // a voice reading the block requests it on every control update, so it has been left
+        // if a voice comes back, the block turns Idle first and is read again after it is unlocked here
+        std::uint8_t state = Ready;
+        if (states_[block].compare_exchange_strong(state, Idle)) {
+            file_.unlock((firstBlock_ + block) * BLOCK_SIZE, BLOCK_SIZE);
+        }
+    }
+}
+
+void SampleStreamer::streamerLoop() {
+    std::vector<std::size_t> requests;
+    requests.reserve(states_.size());
+    auto nextEviction = std::chrono::steady_clock::now() + EVICTION_INTERVAL;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            requested_.wait_until(lock, nextEviction, [this] { return !requests_.empty() || !running_; });
+            if (!running_) {
+                return;
+            }
+            requests.swap(requests_);
+        }
+
+        for (const std::size_t block : requests) {
+            std::uint8_t state = Requested;
+            if (states_[block].load(std::memory_order_relaxed) == state) {
+                read(block);
+                states_[block].compare_exchange_strong(state, Ready, std::memory_order_release);
+            }
+        }
+        requests.clear();
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= nextEviction) {
+            evict();
+            nextEviction = now + EVICTION_INTERVAL;
+        }
+    }
+}
+}
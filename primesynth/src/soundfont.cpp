@@ -1,13 +1,17 @@
 #include "conversion.h"
 #include "soundfont.h"
+#include <algorithm>
 #include <fstream>
 
 namespace primesynth {
+// length of the head of each sample paged in at load when sample points are mapped (seconds)
+static constexpr double PRELOAD_TIME = 0.25;
+
 std::string achToString(const char ach[20]) {
     return {ach, strnlen(ach, 20)};
 }
 
-Sample::Sample(const sf::Sample& sample, const std::vector<std::int16_t>& sampleBuffer)
+Sample::Sample(const sf::Sample& sample, const SampleBuffer& sampleBuffer, bool scanPeak)
     : name(achToString(sample.sampleName)),
       start(sample.start),
       end(sample.end),
@@ -17,7 +21,10 @@ Sample::Sample(const sf::Sample& sample, const std::vector<std::int16_t>& sample
       key(sample.originalKey),
       correction(sample.correction),
       buffer(sampleBuffer) {
-    if (start < end) {
+    if (start < end && !scanPeak) {
+        // assume full scale
+        minAtten = 0.0;
+    } else if (start < end) {
         int sampleMax = 0;
         // if SoundFont file is comformant to specification, generators do not extend sample range beyond start and end
         for (std::size_t i = start; i < end; ++i) {
@@ -406,11 +413,65 @@ Instrument::Instrument(std::vector<sf::Inst>::const_iterator instIter, const std
              sf::Generator::SampleID);
 }
 
+Zone::Range intersect(const Zone::Range& a, const Zone::Range& b) {
+    return {std::max(a.min, b.min), std::min(a.max, b.max)};
+}
+
 Preset::Preset(std::vector<sf::PresetHeader>::const_iterator phdrIter, const std::vector<sf::Bag>& pbag,
                const std::vector<sf::ModList>& pmod, const std::vector<sf::GenList>& pgen, const SoundFont& sfont)
     : name(achToString(phdrIter->presetName)), bank(phdrIter->bank), presetID(phdrIter->preset), soundFont(sfont) {
     readBags(zones, pbag.begin() + phdrIter->presetBagNdx, pbag.begin() + std::next(phdrIter)->presetBagNdx, pmod, pgen,
              sf::Generator::Instrument);
+
+    const auto& instruments = soundFont.getInstruments();
+    for (const Zone& presetZone : zones) {
+        const auto instID = static_cast<std::size_t>(presetZone.generators.getOrDefault(sf::Generator::Instrument));
+        if (instID >= instruments.size()) {
+            continue;
+        }
+        for (const Zone& instZone : instruments.at(instID).zones) {
+            VoiceTemplate voiceTemplate{intersect(presetZone.keyRange, instZone.keyRange),
+                                        intersect(presetZone.velocityRange, instZone.velocityRange),
+                                        instZone.generators.getOrDefault(sf::Generator::SampleID),
+                                        instZone.generators,
+                                        instZone.modulatorParameters};
+            if (voiceTemplate.keyRange.min > voiceTemplate.keyRange.max ||
+                voiceTemplate.velocityRange.min > voiceTemplate.velocityRange.max) {
+                continue;
+            }
+            voiceTemplate.generators.add(presetZone.generators);
+            voiceTemplate.modulatorParameters.mergeAndAdd(presetZone.modulatorParameters);
+            voiceTemplate.modulatorParameters.merge(ModulatorParameterSet::getDefaultParameters());
+            voiceTemplates.push_back(std::move(voiceTemplate));
+        }
+    }
+
+    // count voice templates of each key, and then place them
+    std::array<std::size_t, NUM_KEYS> numTemplates{};
+    for (const auto& voiceTemplate : voiceTemplates) {
+        for (int key = std::max<int>(0, voiceTemplate.keyRange.min); key <= voiceTemplate.keyRange.max; ++key) {
+            ++numTemplates.at(key);
+        }
+    }
+    keyOffsets.at(0) = 0;
+    for (std::size_t key = 0; key < NUM_KEYS; ++key) {
+        keyOffsets.at(key + 1) = keyOffsets.at(key) + numTemplates.at(key);
+    }
+    keyTemplates.resize(keyOffsets.at(NUM_KEYS));
+    std::array<std::size_t, NUM_KEYS> next{};
+    std::copy(keyOffsets.begin(), std::prev(keyOffsets.end()), next.begin());
+    for (const auto& voiceTemplate : voiceTemplates) {
+        for (int key = std::max<int>(0, voiceTemplate.keyRange.min); key <= voiceTemplate.keyRange.max; ++key) {
+            keyTemplates.at(next.at(key)++) = &voiceTemplate;
+        }
+    }
+}
+
+std::pair<Preset::TemplateIterator, Preset::TemplateIterator> Preset::getVoiceTemplates(std::uint8_t key) const {
+    if (key >= NUM_KEYS) {
+        return {keyTemplates.end(), keyTemplates.end()};
+    }
+    return {keyTemplates.begin() + keyOffsets.at(key), keyTemplates.begin() + keyOffsets.at(key + 1)};
 }
 
 struct RIFFHeader {
@@ -438,11 +499,18 @@ constexpr std::uint32_t toFourCC(const char str[5]) {
     return fourCC;
 }
 
-SoundFont::SoundFont(const std::string& filename) {
+SoundFont::SoundFont(const std::string& filename, SampleLoading sampleLoading) : sampleLoading_(sampleLoading) {
     std::ifstream ifs(filename, std::ios::binary);
     if (!ifs) {
         throw std::runtime_error("failed to open file");
     }
+    if (sampleLoading_ != SampleLoading::Read) {
+        try {
+            sampleFile_ = std::make_unique<MappedFile>(filename);
+        } catch (const std::runtime_error&) {
+            // fall back to reading
+        }
+    }
 
     const RIFFHeader riffHeader = readHeader(ifs);
     const std::uint32_t riffType = readFourCC(ifs);
@@ -527,13 +595,29 @@ void SoundFont::readSdtaChunk(std::ifstream& ifs, std::size_t size) {
         const RIFFHeader subchunkHeader = readHeader(ifs);
         s += sizeof(subchunkHeader) + subchunkHeader.size;
         switch (subchunkHeader.id) {
-        case toFourCC("smpl"):
+        case toFourCC("smpl"): {
             if (subchunkHeader.size == 0) {
                 throw std::runtime_error("no sample data found");
             }
-            sampleBuffer_.resize(subchunkHeader.size / sizeof(std::int16_t));
-            ifs.read(reinterpret_cast<char*>(sampleBuffer_.data()), subchunkHeader.size);
+            const auto offset = static_cast<std::size_t>(ifs.tellg());
+            const std::size_t numPoints = subchunkHeader.size / sizeof(std::int16_t);
+            if (sampleFile_ && offset % alignof(std::int16_t) == 0 &&
+                offset + subchunkHeader.size <= sampleFile_->getSize()) {
+                // refer to points in place
+                const auto data = reinterpret_cast<const std::int16_t*>(sampleFile_->getData() + offset);
+                if (sampleLoading_ == SampleLoading::Stream) {
+                    sampleStreamer_ = std::make_unique<SampleStreamer>(*sampleFile_, offset, numPoints);
+                }
+                sampleBuffer_ = {data, numPoints, sampleStreamer_.get()};
+                ifs.seekg(subchunkHeader.size, std::ios::cur);
+            } else {
+                sampleFile_.reset();
+                sampleMemory_.resize(numPoints);
+                ifs.read(reinterpret_cast<char*>(sampleMemory_.data()), subchunkHeader.size);
+                sampleBuffer_ = {sampleMemory_.data(), sampleMemory_.size()};
+            }
             break;
+        }
         default:
             ifs.ignore(subchunkHeader.size);
             break;
@@ -648,7 +732,31 @@ void SoundFont::readPdtaChunk(std::ifstream& ifs, std::size_t size) {
     }
     samples_.reserve(shdr.size() - 1);
     for (auto it_shdr = shdr.begin(); it_shdr != std::prev(shdr.end()); ++it_shdr) {
-        samples_.emplace_back(*it_shdr, sampleBuffer_);
+        samples_.emplace_back(*it_shdr, sampleBuffer_, !sampleFile_);
+    }
+
+    if (sampleStreamer_) {
+        // voices start playing from preloaded heads while the rest is requested,
+        // and short loops are kept ready so that sustained voices need no more reads
+        for (const Sample& sample : samples_) {
+            const auto headLength = static_cast<std::uint32_t>(PRELOAD_TIME * sample.sampleRate);
+            sampleStreamer_->preload(sample.start, std::min(sample.end, sample.start + headLength));
+            if (sample.startLoop < sample.endLoop && sample.endLoop - sample.startLoop <= headLength) {
+                sampleStreamer_->preload(sample.startLoop, sample.endLoop);
+            }
+        }
+    } else if (sampleFile_) {
+        // only heads are hinted, since reading the whole chunk would defeat mapping
+        const auto offset =
+            static_cast<std::size_t>(reinterpret_cast<const char*>(sampleBuffer_.data()) - sampleFile_->getData());
+        for (const Sample& sample : samples_) {
+            if (sample.start < sample.end && sample.end <= sampleBuffer_.size()) {
+                const auto headLength = static_cast<std::uint32_t>(PRELOAD_TIME * sample.sampleRate);
+                const std::uint32_t headEnd = std::min(sample.end, sample.start + headLength);
+                sampleFile_->prefetch(offset + sample.start * sizeof(std::int16_t),
+                                      (headEnd - sample.start) * sizeof(std::int16_t));
+            }
+        }
     }
 }
 }
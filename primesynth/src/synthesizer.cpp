@@ -1,43 +1,155 @@
 #include "synthesizer.h"
+#include <thread>
 
 namespace primesynth {
-Synthesizer::Synthesizer(double outputRate, std::size_t numChannels)
-    : volume_(1.0), midiStd_(midi::Standard::GM), defaultMIDIStd_(midi::Standard::GM), stdFixed_(false) {
-    conv::initialize();
+static constexpr std::size_t BLOCK_SIZE = 256;
+static constexpr std::size_t VOICES_PER_TASK = 16;
+// left, right, reverb and chorus
+static constexpr std::size_t NUM_BUSES = 4;
+static constexpr std::size_t EVENT_QUEUE_SIZE = 4096;
+// voices for which tasks are reserved while polyphony is unlimited
+static constexpr std::size_t UNLIMITED_RESERVED_VOICES = 256;
 
+Synthesizer::Synthesizer(double outputRate, std::size_t numChannels)
+    : midiStd_(midi::Standard::GM),
+      defaultMIDIStd_(midi::Standard::GM),
+      stdFixed_(false),
+      outputRate_(outputRate),
+      volume_(1.0),
+      polyphony_(0),
+      absoluteCullingLevel_(0.0f),
+      relativeCullingLevel_(0.0f),
+      busPeak_(0.0f),
+      renderContext_(),
+      currentNoteID_(0),
+      leftBuffer_(BLOCK_SIZE),
+      rightBuffer_(BLOCK_SIZE),
+      reverb_(outputRate),
+      chorus_(outputRate),
+      reverbBuffer_(BLOCK_SIZE),
+      chorusBuffer_(BLOCK_SIZE),
+      events_(EVENT_QUEUE_SIZE),
+      currentFrame_(0) {
     channels_.reserve(numChannels);
     for (std::size_t i = 0; i < numChannels; ++i) {
         channels_.emplace_back(std::make_unique<Channel>(outputRate));
     }
+    reserveTasks(UNLIMITED_RESERVED_VOICES);
 }
 
-StereoValue Synthesizer::render() const {
-    StereoValue sum{0.0, 0.0};
-    for (const auto& channel : channels_) {
-        sum += channel->render();
+void Synthesizer::renderBlock(float* left, float* right, std::size_t frames) {
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (std::size_t offset = 0; offset < frames;) {
+        processEvents();
+
+        // split block so that next event takes effect on its exact frame
+        std::size_t blockSize = std::min(BLOCK_SIZE, frames - offset);
+        if (const Event* event = events_.front()) {
+            blockSize = static_cast<std::size_t>(std::min<std::uint64_t>(blockSize, event->time - currentFrame_));
+        }
+
+        renderSubBlock(left + offset, right + offset, blockSize);
+        offset += blockSize;
+        currentFrame_ += blockSize;
+    }
+
+    const std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - startTime;
+    if (governor_.update(renderTime.count(), frames / outputRate_)) {
+        // shed voices at once when polyphony limit is lowered
+        limitPolyphony();
+    }
+}
+
+void Synthesizer::renderBlockInterleaved(float* buffer, std::size_t frames) {
+    for (std::size_t offset = 0; offset < frames; offset += BLOCK_SIZE) {
+        const std::size_t blockSize = std::min(BLOCK_SIZE, frames - offset);
+        renderBlock(leftBuffer_.data(), rightBuffer_.data(), blockSize);
+        for (std::size_t i = 0; i < blockSize; ++i) {
+            buffer[2 * (offset + i)] = leftBuffer_.at(i);
+            buffer[2 * (offset + i) + 1] = rightBuffer_.at(i);
+        }
     }
-    return volume_ * sum;
 }
 
-void Synthesizer::loadSoundFont(const std::string& filename) {
-    soundFonts_.emplace_back(std::make_unique<SoundFont>(filename));
+std::uint64_t Synthesizer::getCurrentFrame() const {
+    return currentFrame_;
+}
+
+double Synthesizer::getOutputRate() const {
+    return outputRate_;
+}
+
+std::uint32_t getPresetKey(std::uint16_t bank, std::uint16_t presetID) {
+    return static_cast<std::uint32_t>(bank) << 16 | presetID;
+}
+
+void Synthesizer::loadSoundFont(const std::string& filename, SampleLoading sampleLoading) {
+    soundFonts_.emplace_back(std::make_unique<SoundFont>(filename, sampleLoading));
+    for (const auto& preset : soundFonts_.back()->getPresetPtrs()) {
+        // presets already indexed take precedence
+        presets_.emplace(getPresetKey(preset->bank, preset->presetID), preset);
+    }
+    percussionPreset_ = getPreset(PERCUSSION_BANK, 0);
+    pianoPreset_ = getPreset(0, 0);
 }
 
 void Synthesizer::setVolume(double volume) {
     volume_ = std::max(0.0, volume);
 }
 
+void Synthesizer::setNumThreads(std::size_t numThreads) {
+    if (numThreads > 1) {
+        workerPool_ = std::make_unique<WorkerPool>(numThreads);
+    } else {
+        workerPool_.reset();
+    }
+}
+
+void Synthesizer::setPolyphony(std::size_t polyphony) {
+    polyphony_ = polyphony;
+    // any channel may play all voices
+    for (const auto& channel : channels_) {
+        channel->reserveVoices(polyphony);
+    }
+    // killed voices keep sounding briefly alongside those replacing them
+    reserveTasks(polyphony == 0 ? UNLIMITED_RESERVED_VOICES : 2 * polyphony);
+}
+
+float decibelToAmplitude(double decibel) {
+    return decibel < 0.0 ? static_cast<float>(std::pow(10.0, decibel / 20.0)) : 0.0f;
+}
+
+void Synthesizer::setCullingThresholds(double absoluteThreshold, double relativeThreshold) {
+    absoluteCullingLevel_ = decibelToAmplitude(absoluteThreshold);
+    relativeCullingLevel_ = decibelToAmplitude(relativeThreshold);
+}
+
+void Synthesizer::setInterpolation(kernel::Interpolation interpolation) {
+    for (const auto& channel : channels_) {
+        channel->setInterpolation(interpolation);
+    }
+}
+
+void Synthesizer::setInterpolation(std::size_t channelID, kernel::Interpolation interpolation) {
+    channels_.at(channelID)->setInterpolation(interpolation);
+}
+
+void Synthesizer::setGovernorEnabled(bool enabled) {
+    governor_.setEnabled(enabled);
+}
+
 void Synthesizer::setMIDIStandard(midi::Standard midiStandard, bool fixed) {
     midiStd_ = midiStandard;
     defaultMIDIStd_ = midiStandard;
     stdFixed_ = fixed;
 }
 
-void Synthesizer::processShortMessage(std::uint32_t param) {
+void Synthesizer::processShortMessage(std::uint32_t param, std::uint64_t time) {
     const auto msg = reinterpret_cast<std::uint8_t*>(&param);
     const auto status = msg[0] & 0xf0;
     if (status != 0xf0) {
-        processChannelMessage(param);
+        pushEvent({Event::Type::ShortMessage, param, time});
     }
 }
 
@@ -58,7 +170,7 @@ bool matchSysEx(const char* data, std::size_t length, const std::array<unsigned
     return true;
 }
 
-void Synthesizer::processSysEx(const char* data, std::size_t length) {
+void Synthesizer::processSysEx(const char* data, std::size_t length, std::uint64_t time) {
     static constexpr std::array<unsigned char, 6> GM_SYSTEM_ON = {0xf0, 0x7e, 0, 0x09, 0x01, 0xf7};
     static constexpr std::array<unsigned char, 6> GM_SYSTEM_OFF = {0xf0, 0x7e, 0, 0x09, 0x02, 0xf7};
     static constexpr std::array<unsigned char, 11> GS_RESET = {0xf0, 0x41, 0,    0x42, 0x12, 0x40,
@@ -73,44 +185,199 @@ void Synthesizer::processSysEx(const char* data, std::size_t length) {
         return;
     }
     if (matchSysEx(data, length, GM_SYSTEM_ON)) {
-        midiStd_ = midi::Standard::GM;
+        pushEvent({Event::Type::MIDIStandard, static_cast<std::uint32_t>(midi::Standard::GM), time});
     } else if (matchSysEx(data, length, GM_SYSTEM_OFF)) {
-        midiStd_ = defaultMIDIStd_;
+        pushEvent({Event::Type::MIDIStandard, static_cast<std::uint32_t>(defaultMIDIStd_), time});
     } else if (matchSysEx(data, length, GS_RESET) || matchSysEx(data, length, GS_SYSTEM_MODE_SET1) ||
                matchSysEx(data, length, GS_SYSTEM_MODE_SET2)) {
-        midiStd_ = midi::Standard::GS;
+        pushEvent({Event::Type::MIDIStandard, static_cast<std::uint32_t>(midi::Standard::GS), time});
     } else if (matchSysEx(data, length, XG_SYSTEM_ON)) {
-        midiStd_ = midi::Standard::XG;
+        pushEvent({Event::Type::MIDIStandard, static_cast<std::uint32_t>(midi::Standard::XG), time});
     }
 }
 
-std::shared_ptr<const Preset> Synthesizer::findPreset(std::uint16_t bank, std::uint16_t presetID) const {
-    for (const auto& sf : soundFonts_) {
-        for (const auto& preset : sf->getPresetPtrs()) {
-            if (preset->bank == bank && preset->presetID == presetID) {
-                return preset;
+void Synthesizer::pushEvent(const Event& event) {
+    // dropping events could leave notes stuck, so wait for room instead
+    while (!events_.push(event)) {
+        std::this_thread::yield();
+    }
+}
+
+void Synthesizer::processEvents() {
+    const std::uint64_t now = currentFrame_;
+    for (const Event* event = events_.front(); event && event->time <= now; event = events_.front()) {
+        switch (event->type) {
+        case Event::Type::ShortMessage:
+            processChannelMessage(event->param);
+            break;
+        case Event::Type::MIDIStandard:
+            midiStd_ = static_cast<midi::Standard>(event->param);
+            break;
+        }
+        events_.pop();
+    }
+}
+
+void Synthesizer::renderSubBlock(float* left, float* right, std::size_t frames) {
+    renderContext_.frame = currentFrame_;
+    renderContext_.cullingLevels.finish = absoluteCullingLevel_;
+    renderContext_.cullingLevels.freeze = std::max(absoluteCullingLevel_, relativeCullingLevel_ * busPeak_);
+    renderContext_.qualityLimits = governor_.getLevel().qualityLimits;
+
+    tasks_.clear();
+    for (std::size_t i = 0; i < channels_.size(); ++i) {
+        const std::size_t numVoices = channels_.at(i)->collectActiveVoices();
+        for (std::size_t begin = 0; begin < numVoices; begin += VOICES_PER_TASK) {
+            tasks_.push_back({i, begin, std::min(numVoices, begin + VOICES_PER_TASK)});
+        }
+    }
+    // grows only if voices exceed reserved number
+    if (taskBuffers_.size() < NUM_BUSES * BLOCK_SIZE * tasks_.size()) {
+        taskBuffers_.resize(NUM_BUSES * BLOCK_SIZE * tasks_.size());
+    }
+
+    if (workerPool_) {
+        workerPool_->run(tasks_.size(), [&](std::size_t i) { renderTask(i, frames); });
+    } else {
+        for (std::size_t i = 0; i < tasks_.size(); ++i) {
+            renderTask(i, frames);
+        }
+    }
+
+    std::fill_n(left, frames, 0.0f);
+    std::fill_n(right, frames, 0.0f);
+    std::fill_n(reverbBuffer_.data(), frames, 0.0f);
+    std::fill_n(chorusBuffer_.data(), frames, 0.0f);
+    for (std::size_t i = 0; i < tasks_.size(); ++i) {
+        const Buses buses = getTaskBuses(i);
+        for (std::size_t j = 0; j < frames; ++j) {
+            left[j] += buses.left[j];
+            right[j] += buses.right[j];
+            reverbBuffer_[j] += buses.reverb[j];
+            chorusBuffer_[j] += buses.chorus[j];
+        }
+    }
+    reverb_.process(reverbBuffer_.data(), left, right, frames);
+    chorus_.process(chorusBuffer_.data(), left, right, frames);
+
+    busPeak_ = 0.0f;
+    for (std::size_t j = 0; j < frames; ++j) {
+        busPeak_ = std::max(busPeak_, std::max(std::abs(left[j]), std::abs(right[j])));
+    }
+
+    const auto volume = static_cast<float>(volume_);
+    for (std::size_t j = 0; j < frames; ++j) {
+        left[j] *= volume;
+        right[j] *= volume;
+    }
+}
+
+void Synthesizer::renderTask(std::size_t taskID, std::size_t frames) {
+    const RenderTask& task = tasks_.at(taskID);
+    const Buses buses = getTaskBuses(taskID);
+    std::fill_n(buses.left, frames, 0.0f);
+    std::fill_n(buses.right, frames, 0.0f);
+    std::fill_n(buses.reverb, frames, 0.0f);
+    std::fill_n(buses.chorus, frames, 0.0f);
+    channels_.at(task.channelID)->render(task.beginVoice, task.endVoice, buses, frames, renderContext_);
+}
+
+void Synthesizer::reserveTasks(std::size_t numVoices) {
+    // each channel may add a partly filled task
+    const std::size_t numTasks = numVoices / VOICES_PER_TASK + channels_.size();
+    tasks_.reserve(numTasks);
+    if (taskBuffers_.size() < NUM_BUSES * BLOCK_SIZE * numTasks) {
+        taskBuffers_.resize(NUM_BUSES * BLOCK_SIZE * numTasks);
+    }
+}
+
+Buses Synthesizer::getTaskBuses(std::size_t taskID) {
+    float* const base = taskBuffers_.data() + NUM_BUSES * BLOCK_SIZE * taskID;
+    return {base, base + BLOCK_SIZE, base + 2 * BLOCK_SIZE, base + 3 * BLOCK_SIZE};
+}
+
+// returns true if voice a should be stolen rather than voice b
+bool hasStealingPriority(const Voice& a, const Voice& b) {
+    // finished voices do not count, since their slots are reused
+    // released voices are stolen first, then quietest ones, then oldest ones
+    const bool aReleased = a.getStatus() == Voice::State::Released;
+    const bool bReleased = b.getStatus() == Voice::State::Released;
+    if (aReleased != bReleased) {
+        return aReleased;
+    }
+    const double aAmp = a.getEnvelopeAmplitude();
+    const double bAmp = b.getEnvelopeAmplitude();
+    if (aAmp != bAmp) {
+        return aAmp < bAmp;
+    }
+    return a.getNoteID() < b.getNoteID();
+}
+
+std::size_t Synthesizer::getPolyphonyLimit() const {
+    if (polyphony_ == 0) {
+        return 0;
+    }
+    return std::max<std::size_t>(1, static_cast<std::size_t>(polyphony_ * governor_.getLevel().polyphonyScale));
+}
+
+void Synthesizer::limitPolyphony() {
+    const std::size_t polyphony = getPolyphonyLimit();
+    if (polyphony == 0) {
+        return;
+    }
+
+    std::size_t numVoices = 0;
+    for (const auto& channel : channels_) {
+        numVoices += channel->getNumVoices();
+    }
+    for (; numVoices > polyphony; --numVoices) {
+        Voice* victim = nullptr;
+        for (const auto& channel : channels_) {
+            for (const auto& voice : channel->getVoices()) {
+                // voices of the note just started are never stolen
+                if (voice->getStatus() < Voice::State::Killed && voice->getNoteID() != currentNoteID_ &&
+                    (!victim || hasStealingPriority(*voice, *victim))) {
+                    victim = voice;
+                }
             }
         }
+        if (!victim) {
+            return;
+        }
+        victim->kill();
+    }
+}
+
+std::shared_ptr<const Preset> Synthesizer::getPreset(std::uint16_t bank, std::uint16_t presetID) const {
+    const auto it = presets_.find(getPresetKey(bank, presetID));
+    return it != presets_.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<const Preset> Synthesizer::findPreset(std::uint16_t bank, std::uint16_t presetID) const {
+    if (auto preset = getPreset(bank, presetID)) {
+        return preset;
     }
 
     // fallback
     if (bank == PERCUSSION_BANK) {
-        if (presetID != 0) {
-            // fall back to GM percussion
-            return findPreset(bank, 0);
-        } else {
+        // fall back to GM percussion
+        if (!percussionPreset_) {
             throw std::runtime_error("failed to find preset 128:0 (GM Percussion)");
         }
-    } else if (bank != 0) {
+        return percussionPreset_;
+    }
+    if (bank != 0) {
         // fall back to GM bank
-        return findPreset(0, presetID);
-    } else if (presetID != 0) {
-        // preset not found even in GM bank, fall back to Piano
-        return findPreset(0, 0);
-    } else {
-        // Piano not found, there is no more fallback
+        if (auto preset = getPreset(0, presetID)) {
+            return preset;
+        }
+    }
+    // preset not found even in GM bank, fall back to Piano
+    if (!pianoPreset_) {
+        // there is no more fallback
         throw std::runtime_error("failed to find preset 0:0 (GM Acoustic Grand Piano)");
     }
+    return pianoPreset_;
 }
 
 void Synthesizer::processChannelMessage(unsigned long param) {
@@ -132,7 +399,9 @@ void Synthesizer::processChannelMessage(unsigned long param) {
             channel->setPreset(channelID == midi::PERCUSSION_CHANNEL ? findPreset(PERCUSSION_BANK, 0)
                                                                      : findPreset(0, 0));
         }
-        channel->noteOn(msg[1], msg[2]);
+        channel->noteOn(msg[1], msg[2], currentNoteID_);
+        limitPolyphony();
+        ++currentNoteID_;
         break;
     case midi::MessageStatus::KeyPressure:
         channel->keyPressure(msg[1], msg[2]);
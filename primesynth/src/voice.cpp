@@ -1,34 +1,63 @@
 #include "voice.h"
+#include <algorithm>
 
 namespace primesynth {
-static constexpr unsigned int CALC_INTERVAL = 64;
-
 // for compatibility
 static constexpr double ATTEN_FACTOR = 0.4;
+// range of InitialFilterFc in absolute cents
+static constexpr double MIN_FILTER_CUTOFF = 1500.0;
+static constexpr double MAX_FILTER_CUTOFF = 13500.0;
+
+std::uint16_t getSourceKey(sf::ControllerPalette palette, std::uint8_t index) {
+    return static_cast<std::uint16_t>(static_cast<unsigned int>(palette) << 8 | index);
+}
+
+std::uint16_t getSourceKey(const sf::Modulator& source) {
+    return getSourceKey(source.palette, source.palette == sf::ControllerPalette::General
+                                            ? static_cast<std::uint8_t>(source.index.general)
+                                            : source.index.midi);
+}
+
+// whether value of source can change after note-on
+bool isVaryingSource(const sf::Modulator& source) {
+    if (source.palette == sf::ControllerPalette::MIDI) {
+        return true;
+    }
+    switch (source.index.general) {
+    case sf::GeneralController::NoController:
+    case sf::GeneralController::NoteOnVelocity:
+    case sf::GeneralController::NoteOnKeyNumber:
+        return false;
+    default:
+        return true;
+    }
+}
 
 Voice::Voice(std::size_t noteID, double outputRate, const Sample& sample, const GeneratorSet& generators,
-             const ModulatorParameterSet& modparams, std::uint8_t key, std::uint8_t velocity)
+             const ModulatorParameterSet& modparams, std::uint8_t key, std::uint8_t velocity, Buffers& buffers)
     : noteID_(noteID),
+      outputRate_(outputRate),
       sampleBuffer_(sample.buffer),
       generators_(generators),
       actualKey_(key),
+      modulators_(buffers.modulators),
+      sourceRoutes_(buffers.sourceRoutes),
+      destinationRoutes_(buffers.destinationRoutes),
       percussion_(false),
       fineTuning_(0.0),
       coarseTuning_(0.0),
-      steps_(0),
       status_(State::Playing),
-      index_(sample.start),
       deltaIndex_(0u),
+      targetAmp_(0.0),
       volume_({1.0, 1.0}),
-      amp_(0.0),
-      deltaAmp_(0.0),
-      volEnv_(outputRate, CALC_INTERVAL),
-      modEnv_(outputRate, CALC_INTERVAL),
-      vibLFO_(outputRate, CALC_INTERVAL),
-      modLFO_(outputRate, CALC_INTERVAL) {
-    rtSample_.mode = static_cast<SampleMode>(0b11 & generators.getOrDefault(sf::Generator::SampleModes));
+      volEnv_(outputRate),
+      modEnv_(outputRate),
+      vibLFO_(outputRate),
+      modLFO_(outputRate) {
+    sampleMode_ = static_cast<SampleMode>(0b11 & generators.getOrDefault(sf::Generator::SampleModes));
     const std::int16_t overriddenSampleKey = generators.getOrDefault(sf::Generator::OverridingRootKey);
-    rtSample_.pitch = (overriddenSampleKey > 0 ? overriddenSampleKey : sample.key) - 0.01 * sample.correction;
+    samplePitch_ = (overriddenSampleKey > 0 ? overriddenSampleKey : sample.key) - 0.01 * sample.correction;
+    samplePeak_ = conv::attenuationToAmplitude(sample.minAtten);
 
     static constexpr std::uint32_t COARSE_UNIT = 32768;
     rtSample_.start = sample.start + COARSE_UNIT * generators.getOrDefault(sf::Generator::StartAddrsCoarseOffset) +
@@ -43,17 +72,20 @@ Voice::Voice(std::size_t noteID, double outputRate, const Sample& sample, const
                         generators.getOrDefault(sf::Generator::EndloopAddrsOffset);
 
     // fix invalid sample range
-    const auto bufferSize = static_cast<std::uint32_t>(sample.buffer.size());
+    // the last point of the buffer is kept out of range since interpolation reads one point past the index
+    const auto bufferSize = static_cast<std::uint32_t>(sample.buffer.size()) - 1;
     rtSample_.start = std::min(bufferSize - 1, rtSample_.start);
     rtSample_.end = std::max(rtSample_.start + 1, std::min(bufferSize, rtSample_.end));
     rtSample_.startLoop = std::max(rtSample_.start, std::min(rtSample_.end - 1, rtSample_.startLoop));
     rtSample_.endLoop = std::max(rtSample_.startLoop + 1, std::min(rtSample_.end, rtSample_.endLoop));
 
-    deltaIndexRatio_ = 1.0 / conv::keyToHertz(rtSample_.pitch) * sample.sampleRate / outputRate;
+    deltaIndexRatio_ = 1.0 / conv::keyToHertz(samplePitch_) * sample.sampleRate / outputRate;
 
+    modulators_.clear();
     for (const auto& mp : modparams.getParameters()) {
         modulators_.emplace_back(mp);
     }
+    buildRoutes();
 
     const std::int16_t genVelocity = generators.getOrDefault(sf::Generator::Velocity);
     updateSFController(sf::GeneralController::NoteOnVelocity, genVelocity > 0 ? genVelocity : velocity);
@@ -64,8 +96,11 @@ Voice::Voice(std::size_t noteID, double outputRate, const Sample& sample, const
     updateSFController(sf::GeneralController::NoteOnKeyNumber, overriddenKey);
 
     double minModulatedAtten = ATTEN_FACTOR * generators_.getOrDefault(sf::Generator::InitialAttenuation);
-    for (const auto& mod : modulators_) {
-        if (mod.getDestination() == sf::Generator::InitialAttenuation && mod.canBeNegative()) {
+    const auto attenRoutes =
+        findRoutes(destinationRoutes_, static_cast<std::uint16_t>(sf::Generator::InitialAttenuation));
+    for (auto it = attenRoutes.first; it != attenRoutes.second; ++it) {
+        const Modulator& mod = modulators_[it->modulator];
+        if (mod.canBeNegative()) {
             // mod may increase volume
             minModulatedAtten -= std::abs(mod.getAmount());
         }
@@ -76,12 +111,14 @@ Voice::Voice(std::size_t noteID, double outputRate, const Sample& sample, const
         modulated_.at(i) = generators.getOrDefault(static_cast<sf::Generator>(i));
     }
     static const auto INIT_GENERATORS = {
-        sf::Generator::Pan,           sf::Generator::DelayModLFO,   sf::Generator::FreqModLFO,
-        sf::Generator::DelayVibLFO,   sf::Generator::FreqVibLFO,    sf::Generator::DelayModEnv,
-        sf::Generator::AttackModEnv,  sf::Generator::HoldModEnv,    sf::Generator::DecayModEnv,
-        sf::Generator::SustainModEnv, sf::Generator::ReleaseModEnv, sf::Generator::DelayVolEnv,
-        sf::Generator::AttackVolEnv,  sf::Generator::HoldVolEnv,    sf::Generator::DecayVolEnv,
-        sf::Generator::SustainVolEnv, sf::Generator::ReleaseVolEnv, sf::Generator::CoarseTune};
+        sf::Generator::Pan,              sf::Generator::DelayModLFO,       sf::Generator::FreqModLFO,
+        sf::Generator::DelayVibLFO,      sf::Generator::FreqVibLFO,        sf::Generator::DelayModEnv,
+        sf::Generator::AttackModEnv,     sf::Generator::HoldModEnv,        sf::Generator::DecayModEnv,
+        sf::Generator::SustainModEnv,    sf::Generator::ReleaseModEnv,     sf::Generator::DelayVolEnv,
+        sf::Generator::AttackVolEnv,     sf::Generator::HoldVolEnv,        sf::Generator::DecayVolEnv,
+        sf::Generator::SustainVolEnv,    sf::Generator::ReleaseVolEnv,     sf::Generator::CoarseTune,
+        sf::Generator::InitialFilterFc,  sf::Generator::InitialFilterQ,    sf::Generator::ModEnvToFilterFc,
+        sf::Generator::ModLfoToFilterFc, sf::Generator::ReverbEffectsSend, sf::Generator::ChorusEffectsSend};
     for (const auto& generator : INIT_GENERATORS) {
         updateModulatedParams(generator);
     }
@@ -103,11 +140,101 @@ const Voice::State& Voice::getStatus() const {
     return status_;
 }
 
-StereoValue Voice::render() const {
-    const std::uint32_t i = index_.getIntegerPart();
-    const double r = index_.getFractionalPart();
-    const double interpolated = (1.0 - r) * sampleBuffer_.at(i) + r * sampleBuffer_.at(i + 1);
-    return amp_ * volume_ * (interpolated / INT16_MAX);
+const SampleBuffer& Voice::getSampleBuffer() const {
+    return sampleBuffer_;
+}
+
+const Voice::RuntimeSample& Voice::getRuntimeSample() const {
+    return rtSample_;
+}
+
+bool Voice::isLooping() const {
+    switch (sampleMode_) {
+    case SampleMode::Looped:
+        return true;
+    case SampleMode::LoopedUntilRelease:
+        return status_ < State::Released;
+    default:
+        return false;
+    }
+}
+
+const FixedPoint& Voice::getDeltaIndex() const {
+    return deltaIndex_;
+}
+
+double Voice::getTargetAmplitude() const {
+    return targetAmp_;
+}
+
+const StereoValue& Voice::getVolume() const {
+    return volume_;
+}
+
+double Voice::getEnvelopeAmplitude() const {
+    return volEnv_.getPhase() == Envelope::Phase::Attack
+               ? volEnv_.getValue()
+               : conv::attenuationToAmplitude(960.0 * (1.0 - volEnv_.getValue()));
+}
+
+bool Voice::isDecaying() const {
+    return volEnv_.getPhase() > Envelope::Phase::Hold;
+}
+
+unsigned int Voice::getFramesUntilPhaseChange() const {
+    return volEnv_.getFramesUntilPhaseChange();
+}
+
+double Voice::getSamplePeak() const {
+    return samplePeak_;
+}
+
+bool Voice::isFiltered() const {
+    // cutoff at its maximum without resonance and modulation leaves the sample unchanged
+    if (getModulatedGenerator(sf::Generator::InitialFilterFc) < MAX_FILTER_CUTOFF ||
+        getModulatedGenerator(sf::Generator::InitialFilterQ) > 0.0 ||
+        getModulatedGenerator(sf::Generator::ModEnvToFilterFc) != 0.0 ||
+        getModulatedGenerator(sf::Generator::ModLfoToFilterFc) != 0.0) {
+        return true;
+    }
+
+    // controllers at neutral values at note-on can still move filter parameters later
+    for (const sf::Generator destination :
+         {sf::Generator::InitialFilterFc, sf::Generator::InitialFilterQ, sf::Generator::ModEnvToFilterFc,
+          sf::Generator::ModLfoToFilterFc}) {
+        const auto routes = findRoutes(destinationRoutes_, static_cast<std::uint16_t>(destination));
+        for (auto it = routes.first; it != routes.second; ++it) {
+            const Modulator& mod = modulators_[it->modulator];
+            if (isVaryingSource(mod.getSource()) || isVaryingSource(mod.getAmountSource())) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+double Voice::getFilterCutoff() const {
+    const double cutoff = getModulatedGenerator(sf::Generator::InitialFilterFc) +
+                          getModulatedGenerator(sf::Generator::ModEnvToFilterFc) * getModEnvValue() +
+                          getModulatedGenerator(sf::Generator::ModLfoToFilterFc) * modLFO_.getValue();
+    return conv::absoluteCentToHertz(std::max(MIN_FILTER_CUTOFF, std::min(MAX_FILTER_CUTOFF, cutoff))) / outputRate_;
+}
+
+double Voice::getFilterResonance() const {
+    return getModulatedGenerator(sf::Generator::InitialFilterQ);
+}
+
+double Voice::getReverbSend() const {
+    // in 0.1% units
+    return std::max(0.0, std::min(1.0, 0.001 * getModulatedGenerator(sf::Generator::ReverbEffectsSend)));
+}
+
+double Voice::getChorusSend() const {
+    return std::max(0.0, std::min(1.0, 0.001 * getModulatedGenerator(sf::Generator::ChorusEffectsSend)));
+}
+
+const std::bitset<midi::NUM_CONTROLLERS>& Voice::getMIDIControllers() const {
+    return midiControllers_;
 }
 
 void Voice::setPercussion(bool percussion) {
@@ -115,19 +242,28 @@ void Voice::setPercussion(bool percussion) {
 }
 
 void Voice::updateSFController(sf::GeneralController controller, double value) {
-    for (auto& mod : modulators_) {
+    std::bitset<NUM_GENERATORS> destinations;
+    const auto routes =
+        findRoutes(sourceRoutes_, getSourceKey(sf::ControllerPalette::General, static_cast<std::uint8_t>(controller)));
+    for (auto it = routes.first; it != routes.second; ++it) {
+        Modulator& mod = modulators_[it->modulator];
         if (mod.updateSFController(controller, value)) {
-            updateModulatedParams(mod.getDestination());
+            destinations.set(static_cast<std::size_t>(mod.getDestination()));
         }
     }
+    updateModulatedParams(destinations);
 }
 
 void Voice::updateMIDIController(std::uint8_t controller, std::uint8_t value) {
-    for (auto& mod : modulators_) {
+    std::bitset<NUM_GENERATORS> destinations;
+    const auto routes = findRoutes(sourceRoutes_, getSourceKey(sf::ControllerPalette::MIDI, controller));
+    for (auto it = routes.first; it != routes.second; ++it) {
+        Modulator& mod = modulators_[it->modulator];
         if (mod.updateMIDIController(controller, value)) {
-            updateModulatedParams(mod.getDestination());
+            destinations.set(static_cast<std::size_t>(mod.getDestination()));
         }
     }
+    updateModulatedParams(destinations);
 }
 
 void Voice::updateFineTuning(double fineTuning) {
@@ -162,76 +298,66 @@ void Voice::release(bool sustained) {
     }
 }
 
-void Voice::update() {
-    const bool calc = steps_++ % CALC_INTERVAL == 0;
+void Voice::kill() {
+    if (status_ >= State::Killed) {
+        return;
+    }
 
-    if (calc) {
-        // dynamic range of signed 16 bit samples in centibel
-        static const double DYNAMIC_RANGE = 200.0 * std::log10(INT16_MAX + 1.0);
-        if (volEnv_.getPhase() == Envelope::Phase::Finished ||
-            (volEnv_.getPhase() > Envelope::Phase::Attack &&
-             minAtten_ + 960.0 * (1.0 - volEnv_.getValue()) >= DYNAMIC_RANGE)) {
-            status_ = State::Finished;
-            return;
-        }
+    // release within a millisecond, so that amplitude ramps down to zero without click
+    static constexpr double KILL_RELEASE_TIME = -12000.0;
+    status_ = State::Killed;
+    volEnv_.setParameter(Envelope::Phase::Release, KILL_RELEASE_TIME);
+    volEnv_.release();
+}
 
-        volEnv_.update();
-    }
+void Voice::finish() {
+    status_ = State::Finished;
+}
+
+double Voice::getModulatedGenerator(sf::Generator type) const {
+    return modulated_.at(static_cast<std::size_t>(type));
+}
 
-    index_ += deltaIndex_;
+double Voice::getModEnvValue() const {
+    return modEnv_.getPhase() == Envelope::Phase::Attack ? conv::convex(modEnv_.getValue()) : modEnv_.getValue();
+}
 
-    switch (rtSample_.mode) {
-    case SampleMode::UnLooped:
-    case SampleMode::UnUsed:
-        if (index_.getIntegerPart() >= rtSample_.end) {
-            status_ = State::Finished;
-            return;
+std::pair<Voice::RouteIterator, Voice::RouteIterator> Voice::findRoutes(const std::vector<ModulatorRoute>& routes,
+                                                                        std::uint16_t key) const {
+    return std::equal_range(routes.begin(), routes.end(), ModulatorRoute{key, 0});
+}
+
+void Voice::buildRoutes() {
+    sourceRoutes_.clear();
+    destinationRoutes_.clear();
+    for (std::size_t i = 0; i < modulators_.size(); ++i) {
+        const Modulator& mod = modulators_[i];
+        if (static_cast<std::size_t>(mod.getDestination()) >= NUM_GENERATORS) {
+            // links and unknown generators
+            continue;
         }
-        break;
-    case SampleMode::Looped:
-        if (index_.getIntegerPart() >= rtSample_.endLoop) {
-            index_ -= FixedPoint(rtSample_.endLoop - rtSample_.startLoop);
+
+        const auto index = static_cast<std::uint16_t>(i);
+        destinationRoutes_.push_back({static_cast<std::uint16_t>(mod.getDestination()), index});
+        const std::uint16_t source = getSourceKey(mod.getSource());
+        const std::uint16_t amountSource = getSourceKey(mod.getAmountSource());
+        sourceRoutes_.push_back({source, index});
+        if (amountSource != source) {
+            sourceRoutes_.push_back({amountSource, index});
         }
-        break;
-    case SampleMode::LoopedUntilRelease:
-        if (status_ == State::Released) {
-            if (index_.getIntegerPart() >= rtSample_.end) {
-                status_ = State::Finished;
-                return;
+        for (const sf::Modulator* src : {&mod.getSource(), &mod.getAmountSource()}) {
+            if (src->palette == sf::ControllerPalette::MIDI && src->index.midi < midi::NUM_CONTROLLERS) {
+                midiControllers_.set(src->index.midi);
             }
-        } else if (index_.getIntegerPart() >= rtSample_.endLoop) {
-            index_ -= FixedPoint(rtSample_.endLoop - rtSample_.startLoop);
         }
-        break;
-    default:
-        throw std::runtime_error("unknown sample mode");
-    }
-
-    amp_ += deltaAmp_;
-
-    if (calc) {
-        modEnv_.update();
-        vibLFO_.update();
-        modLFO_.update();
-
-        const double modEnvValue =
-            modEnv_.getPhase() == Envelope::Phase::Attack ? conv::convex(modEnv_.getValue()) : modEnv_.getValue();
-        const double pitch =
-            voicePitch_ + 0.01 * (getModulatedGenerator(sf::Generator::ModEnvToPitch) * modEnvValue +
-                                  getModulatedGenerator(sf::Generator::VibLfoToPitch) * vibLFO_.getValue() +
-                                  getModulatedGenerator(sf::Generator::ModLfoToPitch) * modLFO_.getValue());
-        deltaIndex_ = FixedPoint(deltaIndexRatio_ * conv::keyToHertz(pitch));
-
-        const double attenModLFO = getModulatedGenerator(sf::Generator::ModLfoToVolume) * modLFO_.getValue();
-        const double targetAmp = volEnv_.getPhase() == Envelope::Phase::Attack
-                                     ? volEnv_.getValue() * conv::attenuationToAmplitude(attenModLFO)
-                                     : conv::attenuationToAmplitude(960.0 * (1.0 - volEnv_.getValue()) + attenModLFO);
-        deltaAmp_ = (targetAmp - amp_) / CALC_INTERVAL;
     }
-}
-
-double Voice::getModulatedGenerator(sf::Generator type) const {
-    return modulated_.at(static_cast<std::size_t>(type));
+    // modulators of a destination are summed in their original order
+    // std::stable_sort is avoided since it allocates a temporary buffer
+    const auto compare = [](const ModulatorRoute& a, const ModulatorRoute& b) {
+        return a.key < b.key || (a.key == b.key && a.modulator < b.modulator);
+    };
+    std::sort(sourceRoutes_.begin(), sourceRoutes_.end(), compare);
+    std::sort(destinationRoutes_.begin(), destinationRoutes_.end(), compare);
 }
 
 StereoValue calculatePannedVolume(double pan) {
@@ -245,16 +371,23 @@ StereoValue calculatePannedVolume(double pan) {
     }
 }
 
+void Voice::updateModulatedParams(const std::bitset<NUM_GENERATORS>& destinations) {
+    for (std::size_t i = 0; i < NUM_GENERATORS && destinations.any(); ++i) {
+        if (destinations.test(i)) {
+            updateModulatedParams(static_cast<sf::Generator>(i));
+        }
+    }
+}
+
 void Voice::updateModulatedParams(sf::Generator destination) {
     double& modulated = modulated_.at(static_cast<std::size_t>(destination));
     modulated = generators_.getOrDefault(destination);
     if (destination == sf::Generator::InitialAttenuation) {
         modulated *= ATTEN_FACTOR;
     }
-    for (const auto& mod : modulators_) {
-        if (mod.getDestination() == destination) {
-            modulated += mod.getValue();
-        }
+    const auto routes = findRoutes(destinationRoutes_, static_cast<std::uint16_t>(destination));
+    for (auto it = routes.first; it != routes.second; ++it) {
+        modulated += modulators_[it->modulator].getValue();
     }
 
     switch (destination) {
@@ -321,17 +454,47 @@ void Voice::updateModulatedParams(sf::Generator destination) {
         volEnv_.setParameter(Envelope::Phase::Sustain, modulated);
         break;
     case sf::Generator::ReleaseVolEnv:
-        volEnv_.setParameter(Envelope::Phase::Release, modulated);
+        // killed voices keep their short release
+        if (status_ != State::Killed) {
+            volEnv_.setParameter(Envelope::Phase::Release, modulated);
+        }
         break;
     case sf::Generator::CoarseTune:
     case sf::Generator::FineTune:
     case sf::Generator::ScaleTuning:
     case sf::Generator::Pitch:
-        voicePitch_ = rtSample_.pitch + 0.01 * getModulatedGenerator(sf::Generator::Pitch) +
-                      0.01 * generators_.getOrDefault(sf::Generator::ScaleTuning) * (actualKey_ - rtSample_.pitch) +
+        voicePitch_ = samplePitch_ + 0.01 * getModulatedGenerator(sf::Generator::Pitch) +
+                      0.01 * generators_.getOrDefault(sf::Generator::ScaleTuning) * (actualKey_ - samplePitch_) +
                       coarseTuning_ + getModulatedGenerator(sf::Generator::CoarseTune) +
                       0.01 * (fineTuning_ + getModulatedGenerator(sf::Generator::FineTune));
         break;
     }
 }
+
+void Voice::update(unsigned int frames) {
+    // dynamic range of signed 16 bit samples in centibel
+    static const double DYNAMIC_RANGE = 200.0 * std::log10(INT16_MAX + 1.0);
+    if (volEnv_.getPhase() == Envelope::Phase::Finished ||
+        (volEnv_.getPhase() > Envelope::Phase::Attack &&
+         minAtten_ + 960.0 * (1.0 - volEnv_.getValue()) >= DYNAMIC_RANGE)) {
+        status_ = State::Finished;
+        return;
+    }
+
+    volEnv_.update(frames);
+    modEnv_.update(frames);
+    vibLFO_.update(frames);
+    modLFO_.update(frames);
+
+    const double pitch =
+        voicePitch_ + 0.01 * (getModulatedGenerator(sf::Generator::ModEnvToPitch) * getModEnvValue() +
+                              getModulatedGenerator(sf::Generator::VibLfoToPitch) * vibLFO_.getValue() +
+                              getModulatedGenerator(sf::Generator::ModLfoToPitch) * modLFO_.getValue());
+    deltaIndex_ = FixedPoint(deltaIndexRatio_ * conv::keyToHertz(pitch));
+
+    const double attenModLFO = getModulatedGenerator(sf::Generator::ModLfoToVolume) * modLFO_.getValue();
+    targetAmp_ = volEnv_.getPhase() == Envelope::Phase::Attack
+                     ? volEnv_.getValue() * conv::attenuationToAmplitude(attenModLFO)
+                     : conv::attenuationToAmplitude(960.0 * (1.0 - volEnv_.getValue()) + attenModLFO);
+}
 }
@@ -0,0 +1,695 @@
+#include "voice_kernel.h"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PRIMESYNTH_TARGET(isa)
+#else
+#include <cpuid.h>
+#define PRIMESYNTH_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace primesynth {
+namespace kernel {
+// upper 24 bits of fractional part are used for linear interpolation
+static constexpr float FRACTION_SCALE = 1.0f / (1 << 24);
+
+// coefficients of cubic and sinc interpolation are looked up by upper bits of fractional part
+static constexpr int PHASE_BITS = 8;
+static constexpr std::size_t NUM_PHASES = 1 << PHASE_BITS;
+static constexpr int CUBIC_TAPS = 4;
+static constexpr int SINC_TAPS = 8;
+
+// number of points read before and after the index by each interpolation, including vector loops
+static constexpr std::array<std::uint64_t, 4> POINTS_BEFORE = {0, 0, CUBIC_TAPS / 2 - 1, SINC_TAPS / 2 - 1};
+static constexpr std::array<std::uint64_t, 4> POINTS_AFTER = {1, 1, CUBIC_TAPS / 2, SINC_TAPS / 2};
+
+// row p holds coefficients of consecutive points starting at (TAPS / 2 - 1) points before the index,
+// for fractional part p / NUM_PHASES
+template <int TAPS>
+using CoefficientTable = std::array<float, NUM_PHASES * TAPS>;
+
+CoefficientTable<CUBIC_TAPS> makeCubicTable() {
+    CoefficientTable<CUBIC_TAPS> table;
+    for (std::size_t p = 0; p < NUM_PHASES; ++p) {
+        // Catmull-Rom spline
+        const double x = static_cast<double>(p) / NUM_PHASES;
+        const double x2 = x * x;
+        const double x3 = x2 * x;
+        float* const row = table.data() + CUBIC_TAPS * p;
+        row[0] = static_cast<float>(0.5 * (-x3 + 2.0 * x2 - x));
+        row[1] = static_cast<float>(0.5 * (3.0 * x3 - 5.0 * x2 + 2.0));
+        row[2] = static_cast<float>(0.5 * (-3.0 * x3 + 4.0 * x2 + x));
+        row[3] = static_cast<float>(0.5 * (x3 - x2));
+    }
+    return table;
+}
+
+CoefficientTable<SINC_TAPS> makeSincTable() {
+    static constexpr double PI = 3.141592653589793;
+    static constexpr double HALF_WIDTH = SINC_TAPS / 2;
+    CoefficientTable<SINC_TAPS> table;
+    for (std::size_t p = 0; p < NUM_PHASES; ++p) {
+        const double x = static_cast<double>(p) / NUM_PHASES;
+        std::array<double, SINC_TAPS> coeffs;
+        double sum = 0.0;
+        for (int t = 0; t < SINC_TAPS; ++t) {
+            // Blackman window
+            const double d = t - (SINC_TAPS / 2 - 1) - x;
+            const double sinc = d == 0.0 ? 1.0 : std::sin(PI * d) / (PI * d);
+            const double window =
+                0.42 + 0.5 * std::cos(PI * d / HALF_WIDTH) + 0.08 * std::cos(2.0 * PI * d / HALF_WIDTH);
+            coeffs.at(t) = sinc * window;
+            sum += coeffs.at(t);
+        }
+        // normalize to unity gain at DC
+        for (int t = 0; t < SINC_TAPS; ++t) {
+            table.at(SINC_TAPS * p + t) = static_cast<float>(coeffs.at(t) / sum);
+        }
+    }
+    return table;
+}
+
+alignas(64) static const CoefficientTable<CUBIC_TAPS> cubicTable = makeCubicTable();
+alignas(64) static const CoefficientTable<SINC_TAPS> sincTable = makeSincTable();
+
+template <int TAPS>
+const float* getCoefficientTable();
+
+template <>
+const float* getCoefficientTable<CUBIC_TAPS>() {
+    return cubicTable.data();
+}
+
+template <>
+const float* getCoefficientTable<SINC_TAPS>() {
+    return sincTable.data();
+}
+
+using MixFunction = void (*)(MixParams&, float*, float*, std::size_t);
+using FilterFunction = void (*)(Lowpass* const[], float* const[], std::size_t, std::size_t);
+
+template <bool LINEAR, bool STEREO>
+void mixScalar(MixParams& params, float* left, float* right, std::size_t frames) {
+    std::uint64_t index = params.index;
+    for (std::size_t i = 0; i < frames; ++i) {
+        index += params.deltaIndex;
+        const std::int16_t* s = params.samples + (index >> 32);
+        float interpolated = s[0];
+        if (LINEAR) {
+            const float r = (static_cast<std::uint32_t>(index) >> 8) * FRACTION_SCALE;
+            interpolated += r * (s[1] - s[0]);
+        }
+        const float amp = params.amp + (i + 1) * params.deltaAmp;
+        const float value = amp * interpolated;
+        if (STEREO) {
+            left[i] += params.volumeLeft * value;
+            right[i] += params.volumeRight * value;
+        } else {
+            left[i] += value;
+        }
+    }
+    params.index = index;
+    params.amp += frames * params.deltaAmp;
+}
+
+template <int TAPS, bool STEREO>
+void mixTableScalar(MixParams& params, float* left, float* right, std::size_t frames) {
+    const float* const table = getCoefficientTable<TAPS>();
+    std::uint64_t index = params.index;
+    for (std::size_t i = 0; i < frames; ++i) {
+        index += params.deltaIndex;
+        const std::int16_t* s = params.samples + (index >> 32) - (TAPS / 2 - 1);
+        const float* c = table + TAPS * (static_cast<std::uint32_t>(index) >> (32 - PHASE_BITS));
+        float interpolated = 0.0f;
+        for (int t = 0; t < TAPS; t += 2) {
+            interpolated += c[t] * s[t] + c[t + 1] * s[t + 1];
+        }
+        const float amp = params.amp + (i + 1) * params.deltaAmp;
+        const float value = amp * interpolated;
+        if (STEREO) {
+            left[i] += params.volumeLeft * value;
+            right[i] += params.volumeRight * value;
+        } else {
+            left[i] += value;
+        }
+    }
+    params.index = index;
+    params.amp += frames * params.deltaAmp;
+}
+
+// renders frames which were not processed by vector loop
+void mixRemainder(MixFunction mixScalarFunction, MixParams& params, std::size_t processed, float* left,
+                  float* right, std::size_t frames) {
+    params.index += processed * params.deltaIndex;
+    params.amp += processed * params.deltaAmp;
+    mixScalarFunction(params, left + processed, right + processed, frames - processed);
+}
+
+// reads a point, wrapping points past loop and treating points outside the sample buffer as zero
+float getPoint(const MixParams& params, std::int64_t i) {
+    const auto loopStart = static_cast<std::int64_t>(params.loopStart);
+    const auto loopEnd = static_cast<std::int64_t>(params.loopEnd);
+    if (loopStart < loopEnd && i >= loopEnd) {
+        i = loopStart + (i - loopEnd) % (loopEnd - loopStart);
+    }
+    return i >= 0 && i < static_cast<std::int64_t>(params.numSamples) ? params.samples[i] : 0.0f;
+}
+
+template <int TAPS>
+float interpolateGuarded(const MixParams& params, std::uint64_t index) {
+    const float* c = getCoefficientTable<TAPS>() + TAPS * (static_cast<std::uint32_t>(index) >> (32 - PHASE_BITS));
+    const std::int64_t first = static_cast<std::int64_t>(index >> 32) - (TAPS / 2 - 1);
+    float interpolated = 0.0f;
+    for (int t = 0; t < TAPS; t += 2) {
+        interpolated += c[t] * getPoint(params, first + t) + c[t + 1] * getPoint(params, first + t + 1);
+    }
+    return interpolated;
+}
+
+// renders frames whose points may lie outside the sample buffer or past loop
+void mixGuarded(MixParams& params, Interpolation interpolation, bool stereo, float* left, float* right,
+                std::size_t frames) {
+    std::uint64_t index = params.index;
+    for (std::size_t i = 0; i < frames; ++i) {
+        index += params.deltaIndex;
+        const auto integer = static_cast<std::int64_t>(index >> 32);
+        float interpolated;
+        switch (interpolation) {
+        case Interpolation::None:
+            interpolated = getPoint(params, integer);
+            break;
+        case Interpolation::Linear: {
+            const float s0 = getPoint(params, integer);
+            const float r = (static_cast<std::uint32_t>(index) >> 8) * FRACTION_SCALE;
+            interpolated = s0 + r * (getPoint(params, integer + 1) - s0);
+            break;
+        }
+        case Interpolation::Cubic:
+            interpolated = interpolateGuarded<CUBIC_TAPS>(params, index);
+            break;
+        default:
+            interpolated = interpolateGuarded<SINC_TAPS>(params, index);
+            break;
+        }
+        const float amp = params.amp + (i + 1) * params.deltaAmp;
+        const float value = amp * interpolated;
+        if (stereo) {
+            left[i] += params.volumeLeft * value;
+            right[i] += params.volumeRight * value;
+        } else {
+            left[i] += value;
+        }
+    }
+    params.index = index;
+    params.amp += frames * params.deltaAmp;
+}
+
+std::int32_t loadPair(const std::int16_t* samples, std::uint32_t i) {
+    std::int32_t pair;
+    std::memcpy(&pair, samples + i, sizeof(pair));
+    return pair;
+}
+
+template <bool LINEAR, bool STEREO>
+PRIMESYNTH_TARGET("sse2")
+void mixSSE2(MixParams& params, float* left, float* right, std::size_t frames) {
+    const std::uint64_t index = params.index;
+    const std::uint64_t delta = params.deltaIndex;
+    __m128i indexA = _mm_set_epi64x(index + 2 * delta, index + delta);
+    __m128i indexB = _mm_set_epi64x(index + 4 * delta, index + 3 * delta);
+    const __m128i step = _mm_set1_epi64x(4 * delta);
+    const __m128 ampBase = _mm_add_ps(_mm_set1_ps(params.amp),
+                                      _mm_mul_ps(_mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f), _mm_set1_ps(params.deltaAmp)));
+    const __m128 deltaAmp = _mm_set1_ps(params.deltaAmp);
+    const __m128 volumeLeft = _mm_set1_ps(params.volumeLeft);
+    const __m128 volumeRight = _mm_set1_ps(params.volumeRight);
+    const __m128 fractionScale = _mm_set1_ps(FRACTION_SCALE);
+
+    std::size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        // lanes of indexA and indexB hold frames {1, 2} and {3, 4}, so shuffling them keeps frame order
+        const __m128i integer = _mm_castps_si128(
+            _mm_shuffle_ps(_mm_castsi128_ps(indexA), _mm_castsi128_ps(indexB), _MM_SHUFFLE(3, 1, 3, 1)));
+        const __m128i fraction = _mm_castps_si128(
+            _mm_shuffle_ps(_mm_castsi128_ps(indexA), _mm_castsi128_ps(indexB), _MM_SHUFFLE(2, 0, 2, 0)));
+        alignas(16) std::uint32_t is[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(is), integer);
+        const __m128i pairs = _mm_setr_epi32(loadPair(params.samples, is[0]), loadPair(params.samples, is[1]),
+                                             loadPair(params.samples, is[2]), loadPair(params.samples, is[3]));
+        const __m128 s0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(pairs, 16), 16));
+        __m128 interpolated = s0;
+        if (LINEAR) {
+            const __m128 s1 = _mm_cvtepi32_ps(_mm_srai_epi32(pairs, 16));
+            const __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(fraction, 8)), fractionScale);
+            interpolated = _mm_add_ps(s0, _mm_mul_ps(r, _mm_sub_ps(s1, s0)));
+        }
+
+        const __m128 amp = _mm_add_ps(ampBase, _mm_mul_ps(_mm_set1_ps(static_cast<float>(i)), deltaAmp));
+        const __m128 value = _mm_mul_ps(amp, interpolated);
+        if (STEREO) {
+            _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_mul_ps(volumeLeft, value)));
+            _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(volumeRight, value)));
+        } else {
+            _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), value));
+        }
+
+        indexA = _mm_add_epi64(indexA, step);
+        indexB = _mm_add_epi64(indexB, step);
+    }
+    mixRemainder(mixScalar<LINEAR, STEREO>, params, i, left, right, frames);
+}
+
+template <bool LINEAR, bool STEREO>
+PRIMESYNTH_TARGET("avx2")
+void mixAVX2(MixParams& params, float* left, float* right, std::size_t frames) {
+    const std::uint64_t index = params.index;
+    const std::uint64_t delta = params.deltaIndex;
+    __m256i indexA = _mm256_set_epi64x(index + 6 * delta, index + 5 * delta, index + 2 * delta, index + delta);
+    __m256i indexB = _mm256_set_epi64x(index + 8 * delta, index + 7 * delta, index + 4 * delta, index + 3 * delta);
+    const __m256i step = _mm256_set1_epi64x(8 * delta);
+    const __m256 ampBase = _mm256_add_ps(
+        _mm256_set1_ps(params.amp),
+        _mm256_mul_ps(_mm256_setr_ps(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f), _mm256_set1_ps(params.deltaAmp)));
+    const __m256 deltaAmp = _mm256_set1_ps(params.deltaAmp);
+    const __m256 volumeLeft = _mm256_set1_ps(params.volumeLeft);
+    const __m256 volumeRight = _mm256_set1_ps(params.volumeRight);
+    const __m256 fractionScale = _mm256_set1_ps(FRACTION_SCALE);
+    const auto base = reinterpret_cast<const int*>(params.samples);
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        // lanes of indexA and indexB hold frames {1, 2, 5, 6} and {3, 4, 7, 8},
+        // so in-lane shuffle of them keeps frame order
+        const __m256i integer = _mm256_castps_si256(
+            _mm256_shuffle_ps(_mm256_castsi256_ps(indexA), _mm256_castsi256_ps(indexB), _MM_SHUFFLE(3, 1, 3, 1)));
+        const __m256i fraction = _mm256_castps_si256(
+            _mm256_shuffle_ps(_mm256_castsi256_ps(indexA), _mm256_castsi256_ps(indexB), _MM_SHUFFLE(2, 0, 2, 0)));
+
+        // each 32-bit gather loads a pair of adjacent points
+        const __m256i pairs = _mm256_i32gather_epi32(base, integer, 2);
+        const __m256 s0 = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(pairs, 16), 16));
+        __m256 interpolated = s0;
+        if (LINEAR) {
+            const __m256 s1 = _mm256_cvtepi32_ps(_mm256_srai_epi32(pairs, 16));
+            const __m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(fraction, 8)), fractionScale);
+            interpolated = _mm256_add_ps(s0, _mm256_mul_ps(r, _mm256_sub_ps(s1, s0)));
+        }
+
+        const __m256 amp = _mm256_add_ps(ampBase, _mm256_mul_ps(_mm256_set1_ps(static_cast<float>(i)), deltaAmp));
+        const __m256 value = _mm256_mul_ps(amp, interpolated);
+        if (STEREO) {
+            _mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_loadu_ps(left + i), _mm256_mul_ps(volumeLeft, value)));
+            _mm256_storeu_ps(right + i, _mm256_add_ps(_mm256_loadu_ps(right + i), _mm256_mul_ps(volumeRight, value)));
+        } else {
+            _mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_loadu_ps(left + i), value));
+        }
+
+        indexA = _mm256_add_epi64(indexA, step);
+        indexB = _mm256_add_epi64(indexB, step);
+    }
+    mixRemainder(mixScalar<LINEAR, STEREO>, params, i, left, right, frames);
+}
+
+template <bool LINEAR, bool STEREO>
+PRIMESYNTH_TARGET("avx512f")
+void mixAVX512(MixParams& params, float* left, float* right, std::size_t frames) {
+    const std::uint64_t index = params.index;
+    const std::uint64_t delta = params.deltaIndex;
+    __m512i indexA = _mm512_setr_epi64(index + delta, index + 2 * delta, index + 3 * delta, index + 4 * delta,
+                                       index + 5 * delta, index + 6 * delta, index + 7 * delta, index + 8 * delta);
+    __m512i indexB = _mm512_add_epi64(indexA, _mm512_set1_epi64(8 * delta));
+    const __m512i step = _mm512_set1_epi64(16 * delta);
+    const __m512 ampBase = _mm512_add_ps(
+        _mm512_set1_ps(params.amp),
+        _mm512_mul_ps(_mm512_setr_ps(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f,
+                                     14.0f, 15.0f, 16.0f),
+                      _mm512_set1_ps(params.deltaAmp)));
+    const __m512 deltaAmp = _mm512_set1_ps(params.deltaAmp);
+    const __m512 volumeLeft = _mm512_set1_ps(params.volumeLeft);
+    const __m512 volumeRight = _mm512_set1_ps(params.volumeRight);
+    const __m512 fractionScale = _mm512_set1_ps(FRACTION_SCALE);
+
+    std::size_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        const __m512i integer =
+            _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(_mm512_srli_epi64(indexA, 32))),
+                               _mm512_cvtepi64_epi32(_mm512_srli_epi64(indexB, 32)), 1);
+        const __m512i fraction = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(indexA)),
+                                                    _mm512_cvtepi64_epi32(indexB), 1);
+
+        const __m512i pairs = _mm512_i32gather_epi32(integer, params.samples, 2);
+        const __m512 s0 = _mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(pairs, 16), 16));
+        __m512 interpolated = s0;
+        if (LINEAR) {
+            const __m512 s1 = _mm512_cvtepi32_ps(_mm512_srai_epi32(pairs, 16));
+            const __m512 r = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(fraction, 8)), fractionScale);
+            interpolated = _mm512_fmadd_ps(r, _mm512_sub_ps(s1, s0), s0);
+        }
+
+        const __m512 amp = _mm512_fmadd_ps(_mm512_set1_ps(static_cast<float>(i)), deltaAmp, ampBase);
+        const __m512 value = _mm512_mul_ps(amp, interpolated);
+        if (STEREO) {
+            _mm512_storeu_ps(left + i, _mm512_fmadd_ps(volumeLeft, value, _mm512_loadu_ps(left + i)));
+            _mm512_storeu_ps(right + i, _mm512_fmadd_ps(volumeRight, value, _mm512_loadu_ps(right + i)));
+        } else {
+            _mm512_storeu_ps(left + i, _mm512_add_ps(_mm512_loadu_ps(left + i), value));
+        }
+
+        indexA = _mm512_add_epi64(indexA, step);
+        indexB = _mm512_add_epi64(indexB, step);
+    }
+    mixRemainder(mixScalar<LINEAR, STEREO>, params, i, left, right, frames);
+}
+
+template <int TAPS, bool STEREO>
+PRIMESYNTH_TARGET("avx2")
+void mixTableAVX2(MixParams& params, float* left, float* right, std::size_t frames) {
+    const float* const table = getCoefficientTable<TAPS>();
+    const std::uint64_t index = params.index;
+    const std::uint64_t delta = params.deltaIndex;
+    __m256i indexA = _mm256_set_epi64x(index + 6 * delta, index + 5 * delta, index + 2 * delta, index + delta);
+    __m256i indexB = _mm256_set_epi64x(index + 8 * delta, index + 7 * delta, index + 4 * delta, index + 3 * delta);
+    const __m256i step = _mm256_set1_epi64x(8 * delta);
+    const __m256 ampBase = _mm256_add_ps(
+        _mm256_set1_ps(params.amp),
+        _mm256_mul_ps(_mm256_setr_ps(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f), _mm256_set1_ps(params.deltaAmp)));
+    const __m256 deltaAmp = _mm256_set1_ps(params.deltaAmp);
+    const __m256 volumeLeft = _mm256_set1_ps(params.volumeLeft);
+    const __m256 volumeRight = _mm256_set1_ps(params.volumeRight);
+    const auto base = reinterpret_cast<const int*>(params.samples);
+
+    std::size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        const __m256i integer = _mm256_castps_si256(
+            _mm256_shuffle_ps(_mm256_castsi256_ps(indexA), _mm256_castsi256_ps(indexB), _MM_SHUFFLE(3, 1, 3, 1)));
+        const __m256i fraction = _mm256_castps_si256(
+            _mm256_shuffle_ps(_mm256_castsi256_ps(indexA), _mm256_castsi256_ps(indexB), _MM_SHUFFLE(2, 0, 2, 0)));
+
+        // first point and coefficient row of each frame
+        const __m256i first = _mm256_sub_epi32(integer, _mm256_set1_epi32(TAPS / 2 - 1));
+        const __m256i row = _mm256_mullo_epi32(_mm256_srli_epi32(fraction, 32 - PHASE_BITS), _mm256_set1_epi32(TAPS));
+        __m256 interpolated = _mm256_setzero_ps();
+        for (int t = 0; t < TAPS; t += 2) {
+            const __m256i pairs = _mm256_i32gather_epi32(base, _mm256_add_epi32(first, _mm256_set1_epi32(t)), 2);
+            const __m256 s0 = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(pairs, 16), 16));
+            const __m256 s1 = _mm256_cvtepi32_ps(_mm256_srai_epi32(pairs, 16));
+            const __m256 c0 = _mm256_i32gather_ps(table + t, row, 4);
+            const __m256 c1 = _mm256_i32gather_ps(table + t + 1, row, 4);
+            interpolated = _mm256_add_ps(interpolated, _mm256_add_ps(_mm256_mul_ps(c0, s0), _mm256_mul_ps(c1, s1)));
+        }
+
+        const __m256 amp = _mm256_add_ps(ampBase, _mm256_mul_ps(_mm256_set1_ps(static_cast<float>(i)), deltaAmp));
+        const __m256 value = _mm256_mul_ps(amp, interpolated);
+        if (STEREO) {
+            _mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_loadu_ps(left + i), _mm256_mul_ps(volumeLeft, value)));
+            _mm256_storeu_ps(right + i, _mm256_add_ps(_mm256_loadu_ps(right + i), _mm256_mul_ps(volumeRight, value)));
+        } else {
+            _mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_loadu_ps(left + i), value));
+        }
+
+        indexA = _mm256_add_epi64(indexA, step);
+        indexB = _mm256_add_epi64(indexB, step);
+    }
+    mixRemainder(mixTableScalar<TAPS, STEREO>, params, i, left, right, frames);
+}
+
+template <int TAPS, bool STEREO>
+PRIMESYNTH_TARGET("avx512f")
+void mixTableAVX512(MixParams& params, float* left, float* right, std::size_t frames) {
+    const float* const table = getCoefficientTable<TAPS>();
+    const std::uint64_t index = params.index;
+    const std::uint64_t delta = params.deltaIndex;
+    __m512i indexA = _mm512_setr_epi64(index + delta, index + 2 * delta, index + 3 * delta, index + 4 * delta,
+                                       index + 5 * delta, index + 6 * delta, index + 7 * delta, index + 8 * delta);
+    __m512i indexB = _mm512_add_epi64(indexA, _mm512_set1_epi64(8 * delta));
+    const __m512i step = _mm512_set1_epi64(16 * delta);
+    const __m512 ampBase = _mm512_add_ps(
+        _mm512_set1_ps(params.amp),
+        _mm512_mul_ps(_mm512_setr_ps(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f,
+                                     14.0f, 15.0f, 16.0f),
+                      _mm512_set1_ps(params.deltaAmp)));
+    const __m512 deltaAmp = _mm512_set1_ps(params.deltaAmp);
+    const __m512 volumeLeft = _mm512_set1_ps(params.volumeLeft);
+    const __m512 volumeRight = _mm512_set1_ps(params.volumeRight);
+
+    std::size_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        const __m512i integer =
+            _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(_mm512_srli_epi64(indexA, 32))),
+                               _mm512_cvtepi64_epi32(_mm512_srli_epi64(indexB, 32)), 1);
+        const __m512i fraction = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(indexA)),
+                                                    _mm512_cvtepi64_epi32(indexB), 1);
+
+        // first point and coefficient row of each frame
+        const __m512i first = _mm512_sub_epi32(integer, _mm512_set1_epi32(TAPS / 2 - 1));
+        const __m512i row = _mm512_mullo_epi32(_mm512_srli_epi32(fraction, 32 - PHASE_BITS), _mm512_set1_epi32(TAPS));
+        __m512 interpolated = _mm512_setzero_ps();
+        for (int t = 0; t < TAPS; t += 2) {
+            const __m512i pairs =
+                _mm512_i32gather_epi32(_mm512_add_epi32(first, _mm512_set1_epi32(t)), params.samples, 2);
+            const __m512 s0 = _mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(pairs, 16), 16));
+            const __m512 s1 = _mm512_cvtepi32_ps(_mm512_srai_epi32(pairs, 16));
+            const __m512 c0 = _mm512_i32gather_ps(row, table + t, 4);
+            const __m512 c1 = _mm512_i32gather_ps(row, table + t + 1, 4);
+            interpolated = _mm512_add_ps(interpolated, _mm512_fmadd_ps(c0, s0, _mm512_mul_ps(c1, s1)));
+        }
+
+        const __m512 amp = _mm512_fmadd_ps(_mm512_set1_ps(static_cast<float>(i)), deltaAmp, ampBase);
+        const __m512 value = _mm512_mul_ps(amp, interpolated);
+        if (STEREO) {
+            _mm512_storeu_ps(left + i, _mm512_fmadd_ps(volumeLeft, value, _mm512_loadu_ps(left + i)));
+            _mm512_storeu_ps(right + i, _mm512_fmadd_ps(volumeRight, value, _mm512_loadu_ps(right + i)));
+        } else {
+            _mm512_storeu_ps(left + i, _mm512_add_ps(_mm512_loadu_ps(left + i), value));
+        }
+
+        indexA = _mm512_add_epi64(indexA, step);
+        indexB = _mm512_add_epi64(indexB, step);
+    }
+    mixRemainder(mixTableScalar<TAPS, STEREO>, params, i, left, right, frames);
+}
+
+// states decaying into denormal range are flushed, since arithmetic on denormals is slow
+float flushDenormal(float x) {
+    return std::abs(x) < 1e-20f ? 0.0f : x;
+}
+
+void filterScalar(Lowpass* const filters[], float* const rows[], std::size_t numFilters, std::size_t frames) {
+    for (std::size_t k = 0; k < numFilters; ++k) {
+        Lowpass& f = *filters[k];
+        float* const row = rows[k];
+        LowpassCoefficients c = f.coeffs;
+        float x1 = f.x1, x2 = f.x2, y1 = f.y1, y2 = f.y2;
+        for (std::size_t i = 0; i < frames; ++i) {
+            c.b0 += f.deltas.b0;
+            c.a1 += f.deltas.a1;
+            c.a2 += f.deltas.a2;
+            const float x = row[i];
+            const float y = c.b0 * ((x + x2) + (x1 + x1)) - (c.a1 * y1 + c.a2 * y2);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            row[i] = y;
+        }
+        f.coeffs = c;
+        f.x1 = flushDenormal(x1);
+        f.x2 = flushDenormal(x2);
+        f.y1 = flushDenormal(y1);
+        f.y2 = flushDenormal(y2);
+    }
+}
+
+// lane k holds k-th filter of a bank
+struct LowpassLanes {
+    __m128 b0, a1, a2, deltaB0, deltaA1, deltaA2, x1, x2, y1, y2;
+
+    PRIMESYNTH_TARGET("sse2")
+    __m128 process(__m128 x) {
+        b0 = _mm_add_ps(b0, deltaB0);
+        a1 = _mm_add_ps(a1, deltaA1);
+        a2 = _mm_add_ps(a2, deltaA2);
+        const __m128 sum = _mm_add_ps(_mm_add_ps(x, x2), _mm_add_ps(x1, x1));
+        const __m128 y = _mm_sub_ps(_mm_mul_ps(b0, sum), _mm_add_ps(_mm_mul_ps(a1, y1), _mm_mul_ps(a2, y2)));
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        return y;
+    }
+};
+
+PRIMESYNTH_TARGET("sse2")
+void filterSSE2(Lowpass* const filters[], float* const rows[], std::size_t numFilters, std::size_t frames) {
+    // unused lanes filter silence
+    alignas(16) float values[10][FILTER_BANK_WIDTH] = {};
+    for (std::size_t k = 0; k < numFilters; ++k) {
+        const Lowpass& f = *filters[k];
+        const float fields[10] = {f.coeffs.b0, f.coeffs.a1, f.coeffs.a2, f.deltas.b0, f.deltas.a1,
+                                  f.deltas.a2, f.x1,        f.x2,        f.y1,        f.y2};
+        for (int j = 0; j < 10; ++j) {
+            values[j][k] = fields[j];
+        }
+    }
+    LowpassLanes lanes{_mm_load_ps(values[0]), _mm_load_ps(values[1]), _mm_load_ps(values[2]),
+                       _mm_load_ps(values[3]), _mm_load_ps(values[4]), _mm_load_ps(values[5]),
+                       _mm_load_ps(values[6]), _mm_load_ps(values[7]), _mm_load_ps(values[8]),
+                       _mm_load_ps(values[9])};
+
+    std::size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 x[4];
+        for (std::size_t k = 0; k < 4; ++k) {
+            x[k] = k < numFilters ? _mm_loadu_ps(rows[k] + i) : _mm_setzero_ps();
+        }
+        // x[j] holds j-th frame of all filters after transposition
+        _MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+        for (int j = 0; j < 4; ++j) {
+            x[j] = lanes.process(x[j]);
+        }
+        _MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+        for (std::size_t k = 0; k < numFilters; ++k) {
+            _mm_storeu_ps(rows[k] + i, x[k]);
+        }
+    }
+    for (; i < frames; ++i) {
+        alignas(16) float frame[FILTER_BANK_WIDTH] = {};
+        for (std::size_t k = 0; k < numFilters; ++k) {
+            frame[k] = rows[k][i];
+        }
+        _mm_store_ps(frame, lanes.process(_mm_load_ps(frame)));
+        for (std::size_t k = 0; k < numFilters; ++k) {
+            rows[k][i] = frame[k];
+        }
+    }
+
+    const __m128 fields[7] = {lanes.b0, lanes.a1, lanes.a2, lanes.x1, lanes.x2, lanes.y1, lanes.y2};
+    for (int j = 0; j < 7; ++j) {
+        _mm_store_ps(values[j], fields[j]);
+    }
+    for (std::size_t k = 0; k < numFilters; ++k) {
+        Lowpass& f = *filters[k];
+        f.coeffs = {values[0][k], values[1][k], values[2][k]};
+        f.x1 = flushDenormal(values[3][k]);
+        f.x2 = flushDenormal(values[4][k]);
+        f.y1 = flushDenormal(values[5][k]);
+        f.y2 = flushDenormal(values[6][k]);
+    }
+}
+
+void cpuid(int leaf, int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    __cpuidex(reinterpret_cast<int*>(regs), leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+std::uint64_t xgetbv() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    std::uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<std::uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+InstructionSet detectInstructionSet() {
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    const unsigned int maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    if (!(regs[3] & (1u << 26))) {
+        return InstructionSet::Scalar;
+    }
+
+    // OS must save YMM (and ZMM) registers on context switches
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    if (!osxsave || maxLeaf < 7) {
+        return InstructionSet::SSE2;
+    }
+    const std::uint64_t xcr0 = xgetbv();
+    cpuid(7, 0, regs);
+    if ((regs[1] & (1u << 16)) && (xcr0 & 0xe6) == 0xe6) {
+        return InstructionSet::AVX512;
+    }
+    if ((regs[1] & (1u << 5)) && (xcr0 & 0x6) == 0x6) {
+        return InstructionSet::AVX2;
+    }
+    return InstructionSet::SSE2;
+}
+
+static const InstructionSet instructionSet = detectInstructionSet();
+
+// indexed by Interpolation
+template <bool STEREO>
+std::array<MixFunction, 4> selectMixFunctions(InstructionSet isa) {
+    switch (isa) {
+    case InstructionSet::AVX512:
+        return {mixAVX512<false, STEREO>, mixAVX512<true, STEREO>, mixTableAVX512<CUBIC_TAPS, STEREO>,
+                mixTableAVX512<SINC_TAPS, STEREO>};
+    case InstructionSet::AVX2:
+        return {mixAVX2<false, STEREO>, mixAVX2<true, STEREO>, mixTableAVX2<CUBIC_TAPS, STEREO>,
+                mixTableAVX2<SINC_TAPS, STEREO>};
+    case InstructionSet::SSE2:
+        // table-driven interpolation needs gather instructions to be vectorized
+        return {mixSSE2<false, STEREO>, mixSSE2<true, STEREO>, mixTableScalar<CUBIC_TAPS, STEREO>,
+                mixTableScalar<SINC_TAPS, STEREO>};
+    default:
+        return {mixScalar<false, STEREO>, mixScalar<true, STEREO>, mixTableScalar<CUBIC_TAPS, STEREO>,
+                mixTableScalar<SINC_TAPS, STEREO>};
+    }
+}
+
+static const std::array<MixFunction, 4> stereoMixFunctions = selectMixFunctions<true>(instructionSet);
+static const std::array<MixFunction, 4> monoMixFunctions = selectMixFunctions<false>(instructionSet);
+
+static const FilterFunction filterFunction =
+    instructionSet == InstructionSet::Scalar ? filterScalar : filterSSE2;
+
+InstructionSet getInstructionSet() {
+    return instructionSet;
+}
+
+void mixWithCheck(MixParams& params, Interpolation interpolation, bool stereo, float* left, float* right,
+                  std::size_t frames) {
+    if (frames == 0) {
+        return;
+    }
+
+    // index increases monotonically, so only first and last frames need to be checked
+    const auto i = static_cast<std::size_t>(interpolation);
+    const std::uint64_t first = (params.index + params.deltaIndex) >> 32;
+    const std::uint64_t last = (params.index + frames * params.deltaIndex) >> 32;
+    const bool nearLoopEnd = params.loopStart < params.loopEnd && last + POINTS_AFTER.at(i) >= params.loopEnd;
+    if (first < POINTS_BEFORE.at(i) || last + POINTS_AFTER.at(i) >= params.numSamples || nearLoopEnd) {
+        mixGuarded(params, interpolation, stereo, left, right, frames);
+    } else {
+        (stereo ? stereoMixFunctions : monoMixFunctions).at(i)(params, left, right, frames);
+    }
+}
+
+void mix(MixParams& params, Interpolation interpolation, float* left, float* right, std::size_t frames) {
+    mixWithCheck(params, interpolation, true, left, right, frames);
+}
+
+void mixMono(MixParams& params, Interpolation interpolation, float* output, std::size_t frames) {
+    // right channel is never written
+    mixWithCheck(params, interpolation, false, output, output, frames);
+}
+
+void skip(MixParams& params, std::size_t frames) {
+    params.index += frames * params.deltaIndex;
+    params.amp += frames * params.deltaAmp;
+}
+
+void filter(Lowpass* const filters[], float* const rows[], std::size_t numFilters, std::size_t frames) {
+    filterFunction(filters, rows, numFilters, frames);
+}
+}
+}
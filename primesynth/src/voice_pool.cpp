@@ -0,0 +1,401 @@
+#include "voice_pool.h"
+#include "lowpass.h"
+#include <new>
+
+namespace primesynth {
+// modulators preallocated in each slot, enough for default modulators and those of typical zones
+static constexpr std::size_t RESERVED_MODULATORS = 32;
+
+VoicePool::VoicePool() : interpolation_(kernel::Interpolation::Linear) {}
+
+VoicePool::~VoicePool() {
+    clear();
+}
+
+VoicePool::Iterator VoicePool::begin() const {
+    return voices_.begin();
+}
+
+VoicePool::Iterator VoicePool::end() const {
+    return voices_.end();
+}
+
+void VoicePool::setInterpolation(kernel::Interpolation interpolation) {
+    interpolation_ = interpolation;
+}
+
+void VoicePool::reserve(std::size_t capacity) {
+    while (slots_.size() < capacity) {
+        auto slot = std::make_unique<Slot>();
+        slot->buffers.modulators.reserve(RESERVED_MODULATORS);
+        slot->buffers.sourceRoutes.reserve(2 * RESERVED_MODULATORS);
+        slot->buffers.destinationRoutes.reserve(RESERVED_MODULATORS);
+        slots_.push_back(std::move(slot));
+    }
+    voices_.reserve(capacity);
+    freeSlots_.reserve(capacity);
+    pending_.reserve(capacity);
+    active_.reserve(capacity);
+    looping_.reserve(capacity);
+    frozen_.reserve(capacity);
+    filtered_.reserve(capacity);
+    mono_.reserve(capacity);
+    countdown_.reserve(capacity);
+    samples_.reserve(capacity);
+    numSamples_.reserve(capacity);
+    streamers_.reserve(capacity);
+    index_.reserve(capacity);
+    deltaIndex_.reserve(capacity);
+    amp_.reserve(capacity);
+    deltaAmp_.reserve(capacity);
+    volumeLeft_.reserve(capacity);
+    volumeRight_.reserve(capacity);
+    reverbVolume_.reserve(capacity);
+    chorusVolume_.reserve(capacity);
+    ranges_.reserve(capacity);
+    lowpass_.reserve(capacity);
+    activeSlots_.reserve(capacity);
+    monoBuffer_.reserve(CALC_INTERVAL * capacity);
+}
+
+Voice& VoicePool::add(std::size_t noteID, double outputRate, const Sample& sample, const GeneratorSet& generators,
+                      const ModulatorParameterSet& modparams, std::uint8_t key, std::uint8_t velocity) {
+    const std::size_t slot = findFreeSlot();
+    if (slot == voices_.size()) {
+        if (slot == slots_.size()) {
+            slots_.push_back(std::make_unique<Slot>());
+        }
+        voices_.emplace_back();
+        pending_.emplace_back();
+        active_.emplace_back();
+        looping_.emplace_back();
+        frozen_.emplace_back();
+        filtered_.emplace_back();
+        mono_.emplace_back();
+        countdown_.emplace_back();
+        samples_.emplace_back();
+        numSamples_.emplace_back();
+        streamers_.emplace_back();
+        index_.emplace_back();
+        deltaIndex_.emplace_back();
+        amp_.emplace_back();
+        deltaAmp_.emplace_back();
+        volumeLeft_.emplace_back();
+        volumeRight_.emplace_back();
+        reverbVolume_.emplace_back();
+        chorusVolume_.emplace_back();
+        ranges_.emplace_back();
+        lowpass_.emplace_back();
+    } else {
+        voices_[slot]->~Voice();
+    }
+
+    Slot& memory = *slots_[slot];
+    voices_[slot] =
+        new (&memory.storage) Voice(noteID, outputRate, sample, generators, modparams, key, velocity, memory.buffers);
+    pending_[slot] = true;
+    active_[slot] = false;
+    return *voices_[slot];
+}
+
+void VoicePool::clear() {
+    for (Voice* voice : voices_) {
+        voice->~Voice();
+    }
+    voices_.clear();
+    freeSlots_.clear();
+    pending_.clear();
+    active_.clear();
+    looping_.clear();
+    frozen_.clear();
+    filtered_.clear();
+    mono_.clear();
+    countdown_.clear();
+    samples_.clear();
+    numSamples_.clear();
+    streamers_.clear();
+    index_.clear();
+    deltaIndex_.clear();
+    amp_.clear();
+    deltaAmp_.clear();
+    volumeLeft_.clear();
+    volumeRight_.clear();
+    reverbVolume_.clear();
+    chorusVolume_.clear();
+    ranges_.clear();
+    lowpass_.clear();
+    activeSlots_.clear();
+    monoBuffer_.clear();
+}
+
+std::size_t VoicePool::collectActiveVoices() {
+    activeSlots_.clear();
+    for (std::size_t slot = 0; slot < voices_.size(); ++slot) {
+        if (pending_[slot]) {
+            start(slot);
+        }
+        if (active_[slot]) {
+            activeSlots_.push_back(slot);
+        }
+    }
+    monoBuffer_.resize(CALC_INTERVAL * activeSlots_.size());
+    return activeSlots_.size();
+}
+
+void VoicePool::render(std::size_t begin, std::size_t end, const Buses& buses, std::size_t frames,
+                       const RenderContext& context) {
+    bool hasMonoVoices = false;
+    for (std::size_t i = begin; i < end; ++i) {
+        const std::size_t slot = activeSlots_[i];
+        mono_[slot] = isRenderedInMono(slot);
+        if (mono_[slot]) {
+            hasMonoVoices = true;
+        } else {
+            renderVoice(slot, buses.left, buses.right, 0, frames, context);
+        }
+    }
+    if (hasMonoVoices) {
+        renderMonoVoices(begin, end, buses, frames, context);
+    }
+}
+
+std::size_t VoicePool::findFreeSlot() {
+    if (freeSlots_.empty()) {
+        // in descending order, so that slots with lower indices are used first
+        for (std::size_t slot = voices_.size(); slot-- > 0;) {
+            if (!active_[slot] && !pending_[slot]) {
+                freeSlots_.push_back(slot);
+            }
+        }
+        if (freeSlots_.empty()) {
+            return voices_.size();
+        }
+    }
+    const std::size_t slot = freeSlots_.back();
+    freeSlots_.pop_back();
+    return slot;
+}
+
+void VoicePool::start(std::size_t slot) {
+    const Voice& voice = *voices_[slot];
+    const auto& rtSample = voice.getRuntimeSample();
+    pending_[slot] = false;
+    active_[slot] = voice.getStatus() != Voice::State::Finished;
+    looping_[slot] = voice.isLooping();
+    frozen_[slot] = false;
+    filtered_[slot] = voice.isFiltered();
+    countdown_[slot] = 0;
+    samples_[slot] = voice.getSampleBuffer().data();
+    numSamples_[slot] = voice.getSampleBuffer().size();
+    streamers_[slot] = voice.getSampleBuffer().streamer();
+    index_[slot] = FixedPoint(rtSample.start).getRaw();
+    deltaIndex_[slot] = 0;
+    amp_[slot] = 0.0f;
+    deltaAmp_[slot] = 0.0f;
+    ranges_[slot] = {FixedPoint(rtSample.end).getRaw(), FixedPoint(rtSample.startLoop).getRaw(),
+                     FixedPoint(rtSample.endLoop).getRaw()};
+    updateVolumes(slot, voice);
+    if (filtered_[slot]) {
+        lowpass_[slot] = {calculateLowpass(voice.getFilterCutoff(), voice.getFilterResonance()), {}, 0.0f, 0.0f,
+                          0.0f, 0.0f};
+    }
+}
+
+bool VoicePool::isRenderedInMono(std::size_t slot) const {
+    return filtered_[slot] || reverbVolume_[slot] > 0.0f || chorusVolume_[slot] > 0.0f;
+}
+
+void VoicePool::updateVolumes(std::size_t slot, const Voice& voice) {
+    const StereoValue& volume = voice.getVolume();
+    volumeLeft_[slot] = static_cast<float>(volume.left / INT16_MAX);
+    volumeRight_[slot] = static_cast<float>(volume.right / INT16_MAX);
+
+    // effect sends do not depend on pan, since equal-power panning keeps this sum constant
+    const double monoVolume = std::sqrt(0.5 * (volume.left * volume.left + volume.right * volume.right)) / INT16_MAX;
+    reverbVolume_[slot] = static_cast<float>(voice.getReverbSend() * monoVolume);
+    chorusVolume_[slot] = static_cast<float>(voice.getChorusSend() * monoVolume);
+}
+
+void VoicePool::updateControl(std::size_t slot, std::size_t offset, bool retargetFilter,
+                              const RenderContext& context) {
+    const unsigned int controlInterval = context.qualityLimits.controlInterval;
+    Voice& voice = *voices_[slot];
+
+    // update falls on next boundary, or earlier where volume envelope changes its phase,
+    // so that amplitude ramps follow corners of envelope
+    const auto boundary = static_cast<unsigned int>(controlInterval - (context.frame + offset) % controlInterval);
+    const unsigned int countdown = std::min(boundary, voice.getFramesUntilPhaseChange());
+    voice.update(countdown);
+    if (voice.getStatus() == Voice::State::Finished) {
+        active_[slot] = false;
+        return;
+    }
+
+    looping_[slot] = voice.isLooping();
+    deltaIndex_[slot] = voice.getDeltaIndex().getRaw();
+    countdown_[slot] = countdown;
+    deltaAmp_[slot] = static_cast<float>((voice.getTargetAmplitude() - amp_[slot]) / countdown);
+    updateVolumes(slot, voice);
+    if (filtered_[slot] && retargetFilter) {
+        // coefficients ramp until next boundary, since ramps are shared by frames of a piece
+        kernel::Lowpass& lowpass = lowpass_[slot];
+        const kernel::LowpassCoefficients target =
+            calculateLowpass(voice.getFilterCutoff(), voice.getFilterResonance());
+        lowpass.deltas = {(target.b0 - lowpass.coeffs.b0) / boundary, (target.a1 - lowpass.coeffs.a1) / boundary,
+                          (target.a2 - lowpass.coeffs.a2) / boundary};
+    }
+
+    // estimated peak output during next interval
+    const double amp = std::max<double>(amp_[slot], voice.getTargetAmplitude());
+    const double volume = std::max(voice.getVolume().left, voice.getVolume().right);
+    const auto level = static_cast<float>(amp * volume * voice.getSamplePeak());
+    if (level < context.cullingLevels.finish && voice.isDecaying()) {
+        voice.finish();
+        active_[slot] = false;
+        return;
+    }
+    // points are requested even for culled voices, so that they are ready when voices become audible
+    const bool ready = requestSamplePoints(slot, countdown);
+    frozen_[slot] = level < context.cullingLevels.freeze || !ready;
+}
+
+bool VoicePool::requestSamplePoints(std::size_t slot, unsigned int frames) {
+    SampleStreamer* const streamer = streamers_[slot];
+    if (!streamer) {
+        return true;
+    }
+
+    // interpolation reads a few points around index
+    static constexpr std::uint64_t MARGIN = 8;
+    const SampleRange& range = ranges_[slot];
+    const std::uint64_t begin = index_[slot] >> 32;
+    const std::uint64_t end = ((index_[slot] + deltaIndex_[slot] * frames) >> 32) + 1;
+    const std::uint64_t limit = (looping_[slot] ? range.endLoop : range.end) >> 32;
+    bool ready = streamer->request(begin > MARGIN ? begin - MARGIN : 0, std::min(end, limit) + MARGIN);
+    if (looping_[slot] && end + MARGIN > limit) {
+        // index and points read past loop wrap to the start of loop
+        const std::uint64_t startLoop = range.startLoop >> 32;
+        const std::uint64_t wrapped = std::min(startLoop + (end > limit ? end - limit : 0), limit);
+        ready &= streamer->request(startLoop > MARGIN ? startLoop - MARGIN : 0, wrapped + MARGIN);
+    }
+    return ready;
+}
+
+void VoicePool::renderVoice(std::size_t slot, float* left, float* right, std::size_t offset, std::size_t frames,
+                            const RenderContext& context) {
+    const kernel::Interpolation interpolation = std::min(interpolation_, context.qualityLimits.interpolation);
+    for (std::size_t i = 0; i < frames;) {
+        if (countdown_[slot] == 0) {
+            updateControl(slot, offset + i, i == 0, context);
+            if (!active_[slot]) {
+                return;
+            }
+        }
+
+        // render until next control-rate update
+        const std::size_t numSamples = std::min<std::size_t>(frames - i, countdown_[slot]);
+        const bool looping = looping_[slot] != 0;
+        const bool frozen = frozen_[slot] != 0;
+        const SampleRange& range = ranges_[slot];
+        const std::uint64_t limit = looping ? range.endLoop : range.end;
+        const auto loopStart = static_cast<std::size_t>(looping ? range.startLoop >> 32 : 0);
+        const auto loopEnd = static_cast<std::size_t>(looping ? range.endLoop >> 32 : 0);
+        kernel::MixParams params{samples_[slot], numSamples_[slot], index_[slot],      deltaIndex_[slot],
+                                 amp_[slot],     deltaAmp_[slot],   volumeLeft_[slot], volumeRight_[slot],
+                                 loopStart,      loopEnd};
+        for (std::size_t j = i; j < i + numSamples;) {
+            const std::uint64_t next = params.index + params.deltaIndex;
+            if (next >= limit) {
+                if (!looping) {
+                    voices_[slot]->finish();
+                    active_[slot] = false;
+                    return;
+                }
+                // move index back so that next advance lands inside the loop
+                params.index = range.startLoop + (next - range.startLoop) % (range.endLoop - range.startLoop) -
+                               params.deltaIndex;
+                continue;
+            }
+
+            // frames before index reaches limit
+            const std::size_t remaining = i + numSamples - j;
+            const std::uint64_t steps = params.deltaIndex == 0 ? remaining : 1 + (limit - 1 - next) / params.deltaIndex;
+            const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, steps));
+            if (frozen) {
+                kernel::skip(params, n);
+            } else if (right) {
+                kernel::mix(params, interpolation, left + j, right + j, n);
+            } else {
+                kernel::mixMono(params, interpolation, left + j, n);
+            }
+            j += n;
+        }
+        index_[slot] = params.index;
+        amp_[slot] = params.amp;
+        countdown_[slot] -= static_cast<unsigned int>(numSamples);
+        i += numSamples;
+    }
+}
+
+void VoicePool::renderMonoVoices(std::size_t begin, std::size_t end, const Buses& buses, std::size_t frames,
+                                 const RenderContext& context) {
+    for (std::size_t offset = 0; offset < frames;) {
+        // pieces do not cross control-rate update boundaries, so coefficient ramps are constant within a piece
+        const std::size_t n =
+            std::min<std::size_t>(frames - offset, CALC_INTERVAL - (context.frame + offset) % CALC_INTERVAL);
+        for (std::size_t i = begin; i < end;) {
+            std::size_t slots[kernel::FILTER_BANK_WIDTH];
+            float* rows[kernel::FILTER_BANK_WIDTH];
+            std::size_t numVoices = 0;
+            for (; i < end && numVoices < kernel::FILTER_BANK_WIDTH; ++i) {
+                const std::size_t slot = activeSlots_[i];
+                if (!active_[slot] || !mono_[slot]) {
+                    continue;
+                }
+                float* const row = monoBuffer_.data() + CALC_INTERVAL * i;
+                std::fill_n(row, n, 0.0f);
+                renderVoice(slot, row, nullptr, offset, n, context);
+                slots[numVoices] = slot;
+                rows[numVoices] = row;
+                ++numVoices;
+            }
+
+            kernel::Lowpass* filters[kernel::FILTER_BANK_WIDTH];
+            float* filteredRows[kernel::FILTER_BANK_WIDTH];
+            std::size_t numFilters = 0;
+            for (std::size_t k = 0; k < numVoices; ++k) {
+                if (filtered_[slots[k]]) {
+                    filters[numFilters] = &lowpass_[slots[k]];
+                    filteredRows[numFilters] = rows[k];
+                    ++numFilters;
+                }
+            }
+            kernel::filter(filters, filteredRows, numFilters, n);
+
+            for (std::size_t k = 0; k < numVoices; ++k) {
+                const std::size_t slot = slots[k];
+                const float* const row = rows[k];
+                const float volumeLeft = volumeLeft_[slot];
+                const float volumeRight = volumeRight_[slot];
+                for (std::size_t j = 0; j < n; ++j) {
+                    buses.left[offset + j] += volumeLeft * row[j];
+                    buses.right[offset + j] += volumeRight * row[j];
+                }
+                const float reverbVolume = reverbVolume_[slot];
+                if (reverbVolume > 0.0f) {
+                    for (std::size_t j = 0; j < n; ++j) {
+                        buses.reverb[offset + j] += reverbVolume * row[j];
+                    }
+                }
+                const float chorusVolume = chorusVolume_[slot];
+                if (chorusVolume > 0.0f) {
+                    for (std::size_t j = 0; j < n; ++j) {
+                        buses.chorus[offset + j] += chorusVolume * row[j];
+                    }
+                }
+            }
+        }
+        offset += n;
+    }
+}
+}
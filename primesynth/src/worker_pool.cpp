@@ -0,0 +1,91 @@
+#include "worker_pool.h"
+#include <immintrin.h>
+
+namespace primesynth {
+static constexpr int SPIN_COUNT = 4096;
+
+WorkerPool::WorkerPool(std::size_t numThreads)
+    : running_(true), generation_(0), task_(nullptr), claim_(0), remainingTasks_(0) {
+    for (std::size_t i = 1; i < numThreads; ++i) {
+        threads_.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+std::size_t WorkerPool::getNumThreads() const {
+    return threads_.size() + 1;
+}
+
+void WorkerPool::run(std::size_t numTasks, const Task& task) {
+    if (numTasks == 0) {
+        return;
+    } else if (numTasks > MAX_TASKS) {
+        throw std::invalid_argument("too many tasks");
+    }
+
+    task_ = &task;
+    remainingTasks_ = numTasks;
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        generation = generation_ + 1;
+        // tasks are claimable before workers see new generation
+        claim_ = (generation & 0xffffffff) << 32 | static_cast<std::uint64_t>(numTasks) << 16;
+        generation_ = generation;
+    }
+    cv_.notify_all();
+
+    executeTasks(generation);
+    while (remainingTasks_ > 0) {
+        _mm_pause();
+    }
+}
+
+void WorkerPool::workerLoop() {
+    std::uint64_t seen = 0;
+    while (true) {
+        for (int i = 0; i < SPIN_COUNT && generation_ == seen && running_; ++i) {
+            _mm_pause();
+        }
+        if (generation_ == seen && running_) {
+            std::unique_lock<std::mutex> uniqueLock(mutex_);
+            cv_.wait(uniqueLock, [&] { return generation_ != seen || !running_; });
+        }
+        if (!running_) {
+            return;
+        }
+
+        seen = generation_;
+        executeTasks(seen);
+    }
+}
+
+void WorkerPool::executeTasks(std::uint64_t generation) {
+    std::uint64_t claim = claim_;
+    while (true) {
+        const std::uint64_t index = claim & 0xffff;
+        if (claim >> 32 != (generation & 0xffffffff) || index >= (claim >> 16 & 0xffff)) {
+            return;
+        }
+        // fails if another thread has claimed the task or a new run has started
+        if (claim_.compare_exchange_weak(claim, claim + 1)) {
+            // run() cannot return, and thus task cannot change, until claimed task is completed
+            (*task_)(static_cast<std::size_t>(index));
+            --remainingTasks_;
+            claim = claim_;
+        }
+    }
+}
+}
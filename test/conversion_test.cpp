@@ -0,0 +1,70 @@
+#include "conversion.h"
+#include <cmath>
+#include <cstdio>
+
+using namespace primesynth;
+
+// table-driven conversions are compared against std::pow and std::log10
+static int numFailures = 0;
+
+static void expectNear(const char* name, double x, double actual, double expected, double tolerance) {
+    if (!(std::abs(actual - expected) <= tolerance)) {
+        std::printf("%s(%g) = %.17g, expected %.17g\n", name, x, actual, expected);
+        ++numFailures;
+    }
+}
+
+static void expectRelative(const char* name, double x, double actual, double expected, double tolerance) {
+    expectNear(name, x, actual, expected, tolerance * std::abs(expected));
+}
+
+// relative error of linear interpolation over 256 steps of 2^x
+static constexpr double EXP2_TOLERANCE = 2e-6;
+// absolute error of log2 in centibel
+static constexpr double ATTENUATION_TOLERANCE = 1e-3;
+
+static double concave(double x) {
+    return 2.0 * -200.0 * std::log10(1.0 - x) / 960.0;
+}
+
+int main() {
+    for (double atten = 0.0; atten < 1440.0; atten += 0.37) {
+        expectRelative("attenuationToAmplitude", atten, conv::attenuationToAmplitude(atten),
+                       std::pow(10.0, -atten / 200.0), EXP2_TOLERANCE);
+    }
+    for (double amp = 1e-9; amp <= 1.0; amp *= 1.01) {
+        expectNear("amplitudeToAttenuation", amp, conv::amplitudeToAttenuation(amp), -200.0 * std::log10(amp),
+                   ATTENUATION_TOLERANCE);
+    }
+    for (double key = 0.0; key < 141.0; key += 0.013) {
+        expectRelative("keyToHertz", key, conv::keyToHertz(key), 440.0 * std::pow(2.0, (key - 69.0) / 12.0),
+                       EXP2_TOLERANCE);
+    }
+    for (double tc = -12000.0; tc < 8000.0; tc += 1.7) {
+        expectRelative("timecentToSecond", tc, conv::timecentToSecond(tc), std::pow(2.0, tc / 1200.0),
+                       EXP2_TOLERANCE);
+    }
+    for (double ac = -16000.0; ac < 13500.0; ac += 1.3) {
+        expectRelative("absoluteCentToHertz", ac, conv::absoluteCentToHertz(ac),
+                       8.176 * std::pow(2.0, ac / 1200.0), EXP2_TOLERANCE);
+    }
+    for (double x = 0.0007; x < 1.0; x += 0.0007) {
+        expectNear("concave", x, conv::concave(x), concave(x), 1e-6);
+        expectNear("convex", x, conv::convex(x), 1.0 - concave(1.0 - x), 1e-6);
+    }
+
+    // fractional part of tiny negative exponents rounds to exactly 1, which must not read past the table
+    // reading past it gives right values by chance, but is reported by AddressSanitizer
+    for (const double tiny : {4.9e-324, 1e-300, 1e-17}) {
+        expectRelative("attenuationToAmplitude", tiny, conv::attenuationToAmplitude(tiny), 1.0, EXP2_TOLERANCE);
+        expectRelative("timecentToSecond", -tiny, conv::timecentToSecond(-tiny), 1.0, EXP2_TOLERANCE);
+    }
+    expectRelative("keyToHertz", 69.0 - 1e-14, conv::keyToHertz(69.0 - 1e-14), 440.0, EXP2_TOLERANCE);
+
+    if (numFailures > 0) {
+        std::printf("%d conversion tests failed\n", numFailures);
+        return 1;
+    }
+    std::printf("conversion tests passed\n");
+    return 0;
+}